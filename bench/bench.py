@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+"""
+Benchmark harness for sudoku_serial and the MPI binary.
+
+Strong scaling: every puzzle of bench/suite.txt is solved by sudoku_serial and by the MPI binary with each process
+count, --repeat times, and the median, the standard deviation, the speedup over the serial median and the parallel
+efficiency are printed. Weak scaling: with p processes the MPI binary solves p copies of the puzzles of
+bench/weak.txt in batch mode, so the work per process stays the same and the ideal time is flat.
+
+The times are the ones printed by the binaries ("total time is X ms", monotonic clock), so the start-up of mpirun is
+left out. The number of solutions of every run is checked against the suite, a wrong count fails the run.
+
+With --find=N (default 1000) every puzzle is also solved once by the MPI binary with each process count above 1 and
+--find=N, and the count must be exactly min(N, solutions): the processes stop at N on their own, the total must not add up.
+
+--save FILE writes the medians as a baseline, --compare FILE fails when a median is slower than the baseline by more
+than --tolerance, so an optimization can be checked against the same inputs before it is trusted.
+
+    python3 bench/bench.py --procs 1,2,4,8 --repeat 5 --save baseline.json
+    python3 bench/bench.py --procs 1,2,4,8 --repeat 5 --compare baseline.json --options=--order=mrv
+"""
+
+import argparse
+import json
+import os
+import re
+import shlex
+import statistics
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+TIME = re.compile(r"total time is ([0-9.]+) ms")
+SOLUTIONS = re.compile(r"num of solutions is (\d+)")
+
+
+def read_suite(path):
+    """Read the puzzles of the suite, a list of (name, grade, solutions, puzzle)."""
+    suite = []
+    with open(path) as f:
+        for line in f:
+            if not line.strip() or line.startswith("#"):
+                continue
+            name, grade, solutions, puzzle = line.split()
+            suite.append((name, grade, int(solutions), puzzle))
+    return suite
+
+
+def triples(puzzle):
+    """The x y value arguments of a puzzle of 81 characters."""
+    args = []
+    for i, c in enumerate(puzzle):
+        if c not in "0.":
+            args += [str(i // 9 + 1), str(i % 9 + 1), c]
+    return args
+
+
+def run(command, timeout):
+    """Run a binary once, return (milliseconds, solutions) from its output."""
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE, universal_newlines=True,
+                            timeout=timeout)
+    # The batch mode prints its totals to stderr
+    output = result.stdout + result.stderr
+    time = TIME.search(output)
+    solutions = SOLUTIONS.search(output)
+    if result.returncode != 0 or not time or not solutions:
+        sys.exit("Failed: %s\n%s" % (" ".join(command), output[-2000:]))
+    return float(time.group(1)), int(solutions.group(1))
+
+
+def measure(command, expected, repeat, timeout):
+    """Run a binary repeat times, check the number of solutions, return the times in milliseconds."""
+    times = []
+    for _ in range(repeat):
+        ms, solutions = run(command, timeout)
+        if expected is not None and solutions != expected:
+            sys.exit("Wrong number of solutions %d instead of %d: %s" % (solutions, expected, " ".join(command)))
+        times.append(ms)
+    return times
+
+
+def summary(times):
+    return {"median": statistics.median(times), "stdev": statistics.stdev(times) if len(times) > 1 else 0.0,
+            "runs": times}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Strong and weak scaling benchmark of sudoku_serial and sudoku_mpi")
+    parser.add_argument("--serial", default="./sudoku_serial", help="the serial binary")
+    parser.add_argument("--mpi", default="./sudoku_mpi", help="the MPI binary")
+    parser.add_argument("--mpirun", default="mpirun", help="the launcher and its options, e.g. 'mpirun --oversubscribe'")
+    parser.add_argument("--procs", default="1,2,4", help="the process counts, comma separated")
+    parser.add_argument("--repeat", type=int, default=5, help="runs per measurement, the median is reported")
+    parser.add_argument("--options", default="", help="solver options passed to both binaries, e.g. --options=--order=mrv")
+    parser.add_argument("--only", default="", help="the names of the suite puzzles to run, comma separated")
+    parser.add_argument("--suite", default=os.path.join(HERE, "suite.txt"))
+    parser.add_argument("--weak", default=os.path.join(HERE, "weak.txt"), help="the weak-scaling unit, '' to skip")
+    parser.add_argument("--find", type=int, default=1000, help="the limit of the --find check, 0 to skip it")
+    parser.add_argument("--timeout", type=float, default=600, help="seconds before a run is given up")
+    parser.add_argument("--save", help="write the results to this JSON file")
+    parser.add_argument("--compare", help="compare the medians with this JSON file written by --save")
+    parser.add_argument("--tolerance", type=float, default=0.10, help="slowdown over the baseline counted as a regression")
+    args = parser.parse_args()
+
+    procs = [int(p) for p in args.procs.split(",")]
+    options = shlex.split(args.options)
+    mpirun = shlex.split(args.mpirun)
+    suite = read_suite(args.suite)
+    if args.only:
+        names = args.only.split(",")
+        suite = [entry for entry in suite if entry[0] in names]
+    results = {}
+
+    print("Strong scaling, %d runs per point, times in ms" % args.repeat)
+    print("%-16s %-8s %5s %12s %10s %8s %10s" % ("puzzle", "grade", "procs", "median", "stdev", "speedup", "efficiency"))
+    for name, grade, solutions, puzzle in suite:
+        serial = summary(measure([args.serial, "--count-only"] + options + triples(puzzle), solutions, args.repeat, args.timeout))
+        results["strong/%s/serial" % name] = serial
+        print("%-16s %-8s %5s %12.3f %10.3f %8s %10s" % (name, grade, "serial", serial["median"], serial["stdev"], "1.00", "-"))
+        for p in procs:
+            command = mpirun + ["-np", str(p), args.mpi] + options + triples(puzzle)
+            point = summary(measure(command, solutions, args.repeat, args.timeout))
+            results["strong/%s/%d" % (name, p)] = point
+            speedup = serial["median"] / point["median"] if point["median"] > 0 else 0
+            print("%-16s %-8s %5d %12.3f %10.3f %8.2f %10.2f" % (name, grade, p, point["median"], point["stdev"], speedup,
+                                                                 speedup / p))
+
+    if args.find > 0:
+        print()
+        print("Check of --find=%d with more than one process" % args.find)
+        for name, grade, solutions, puzzle in suite:
+            for p in procs:
+                if p > 1:
+                    command = mpirun + ["-np", str(p), args.mpi, "--find=%d" % args.find] + options + triples(puzzle)
+                    measure(command, min(args.find, solutions), 1, args.timeout)
+            print("%-16s ok" % name)
+
+    if args.weak:
+        with open(args.weak) as f:
+            unit = [line for line in f if line.strip() and not line.startswith("#")]
+        print()
+        print("Weak scaling, %d puzzles per process, %d runs per point, times in ms" % (len(unit), args.repeat))
+        print("%5s %8s %12s %10s %10s" % ("procs", "puzzles", "median", "stdev", "efficiency"))
+        base = None
+        for p in procs:
+            with tempfile.NamedTemporaryFile("w", suffix=".txt", delete=False) as batch:
+                batch.writelines(unit * p)
+            try:
+                command = mpirun + ["-np", str(p), args.mpi] + options + ["--batch=" + batch.name]
+                point = summary(measure(command, None, args.repeat, args.timeout))
+            finally:
+                os.unlink(batch.name)
+            results["weak/%d" % p] = point
+            base = base or point["median"]
+            print("%5d %8d %12.3f %10.3f %10.2f" % (p, len(unit) * p, point["median"], point["stdev"],
+                                                   base / point["median"] if point["median"] > 0 else 0))
+
+    if args.save:
+        with open(args.save, "w") as f:
+            json.dump({"options": args.options, "results": results}, f, indent=2)
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)["results"]
+        regressions = 0
+        print()
+        print("Compared with %s, tolerance %.0f%%" % (args.compare, 100 * args.tolerance))
+        for key in sorted(set(results) & set(baseline)):
+            ratio = results[key]["median"] / baseline[key]["median"] if baseline[key]["median"] > 0 else 1
+            flag = ""
+            if ratio > 1 + args.tolerance:
+                flag = "  REGRESSION"
+                regressions += 1
+            print("%-28s %12.3f -> %12.3f  %6.2fx%s" % (key, baseline[key]["median"], results[key]["median"], ratio, flag))
+        if regressions:
+            sys.exit("%d regressions" % regressions)
+
+
+if __name__ == "__main__":
+    main()
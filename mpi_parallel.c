@@ -1,197 +1,2500 @@
 #include "sudoku_parallel.h"
+#include "sudoku_solver.h"
+#include "sudoku_pool.h"
+#include "sudoku_io.h"
+#include "sudoku_serve.h"
+#include "sudoku_cache.h"
+#include "sudoku_checkpoint.h"
 #include <mpi.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <signal.h>
 
-const int MAX_STRING = 100;
+// Tags of the messages between the master process and the slave processes, the results are collected by MPI_Reduce
+const int TAG_REQUEST = 1; // slave -> master: struct TaskRequest, asking for the next chunk of tasks
+const int TAG_WORK = 2;    // master -> slave: struct TaskChunk, count == 0 means there is no task left
+const int TAG_STEAL = 3;   // master -> slave: empty, asking a busy slave process to give away part of its work
+const int TAG_DONATE = 4;  // slave -> master: the answer to TAG_STEAL, an array of 0 or more struct Task records
+const int TAG_FOUND = 5;   // slave -> master: a long long, the solutions found since its last TAG_FOUND message (--find)
+const int TAG_CANCEL = 6;  // master -> slave: empty, the number of solutions asked by --find is reached, every search stops
+const int TAG_CHECKPOINT = 7; // master -> slave: empty, asking for the work it has left (--checkpoint); slave -> master: struct CheckpointReply
+const int TAG_DROP = 8;       // master -> slave: a long long, the first task of a chunk another process finished first (--speculate)
+
+// The master process sizes the chunks so that one chunk takes about CHUNK_SECONDS for a slave process
+const double CHUNK_SECONDS = 0.05;
+
+// A slave process which had nothing to give away is asked again after STEAL_RETRY_SECONDS at the earliest
+const double STEAL_RETRY_SECONDS = 0.01;
+
+// With --speculate, a chunk is overdue once it runs SPECULATE_FACTOR times as long as its tasks should take at the average cost, and at
+// least SPECULATE_SECONDS, see Speculate
+const double SPECULATE_FACTOR = 4.0;
+const double SPECULATE_SECONDS = 1.0;
+
+// State of each process in the work queue
+#define RANK_BUSY 0    // Working on a chunk of tasks
+#define RANK_WAITING 1 // Asked for work while the queue was empty, waiting for donated tasks
+#define RANK_STOPPED 2 // Told that there is no task left
+
+// Each process works on the tasks in chunks of at most MAX_CHUNK_TASKS tasks
+#define MAX_CHUNK_TASKS 256
+
+// By default SolverSplit is asked for TASKS_PER_PROCESS tasks per process, see --tasks-per-process
+#define TASKS_PER_PROCESS 16
+
+// In batch mode (--batch=FILE) the master process reads the puzzles in blocks of BATCH_BLOCK puzzles, and writes the results of a block
+// in input order before it reads the next one
+#define BATCH_BLOCK 4096
+
+// In the hybrid mode (--threads=N), the main thread of a process sleeps POLL_NANOSECONDS between two looks at the messages and the pool
+#define POLL_NANOSECONDS 200000
+
+// ReportLoad lists as stragglers the processes which spent more than STRAGGLER_RATIO times the mean solving time on their tasks
+#define STRAGGLER_RATIO 1.1
+
+// With --checkpoint=FILE the master process writes a checkpoint every CHECKPOINT_SECONDS by default, see --checkpoint-interval
+#define CHECKPOINT_SECONDS 600
 
 // Store the basic infomation to devide the computing workload to multiple processes
 struct Params
 {
-    int workID;     // Process ID
-    int comm_sz;    // comm_sz: [3, 10], [11, 82], [83, 730]
-    int level;      // level: 1, 2, 3; which is calculated by GetLevel function based on the value of comm_sz
-    int taskNum;    // taskNum: 9, 81, 729; which is calculated by GetTaskNum function based on the value of level
-    char param[3];  // params: (param[0]), (param[0], param[1]), (param[0], param[1], param[2])
+    int workID;          // Process ID
+    int comm_sz;         // The number of MPI processes, any value >= 1
+    int tasksPerProcess; // SolverSplit is asked for comm_sz * tasksPerProcess tasks
+    int threads;         // The number of worker threads per process, 1 means the process solves its tasks itself
+    const char *batch;   // The puzzle file of the batch mode, NULL when the puzzle is given on the command line
+    const char *solutions; // The index of the solution files, NULL when the solutions are not written, see WriteSolutionIndex
+    const char *report;  // The JSON file of the load report, NULL when the report is only printed, see ReportLoad
+    const char *serve;   // The socket of the solver service, NULL when the puzzle is given on the command line, see masterServe
+    const char *cache;   // The file of the result cache, "" to keep it in memory only, NULL without --cache, see sudoku_cache.h
+    const char *checkpoint;    // The checkpoint file, NULL when no checkpoint is written, see TakeCheckpoint
+    double checkpointInterval; // The seconds between two checkpoints
+    int restart;               // 1: resume the count from the checkpoint file instead of splitting the puzzle
+    int speculate;             // 1: hand the overdue chunks out again to the waiting processes, see Speculate
 };
 
-// Store the number of the solutions to soduku puzzle calculated by the current process ( process ID: workID)
+// Store the number of the solutions to soduku puzzle calculated by the current process, and the counters of its search. The results of
+// all the processes are added up by MPI_Reduce with ResultType and ResultSum
 struct Result
 {
-    int workID; // Process ID
-    int count;  // The number of the solutions calculated by the current process
+    long long count;      // The number of the solutions calculated by the current process
+    long long nodes;      // The number of search nodes, SolverTotals.nodes
+    long long propagated; // The number of cells filled by propagation, SolverTotals.propagated
+    int tasks;            // The number of tasks solved
+};
+
+static MPI_Datatype ResultType;
+static MPI_Op ResultSum;
+
+// The load of a process, gathered by the master process at the end to show how the work and the time were shared out (ReportLoad)
+struct RankLoad
+{
+    long long count;       // The number of solutions found
+    long long tasks;       // The number of tasks solved, puzzles in batch mode
+    long long nodes;       // The counters of the solver, SolverTotals
+    long long backtracks;
+    long long checks;
+    long long propagated;
+    double solveSeconds;   // The time spent solving tasks, added over the worker threads
+    double slowestTask;    // The time of the longest task
+    double blockedSeconds; // The time spent blocked in MPI, waiting for a message or for the other processes
+    double wallSeconds;    // The time from the start of the work of the process to the end of CollectResults
+};
+
+static struct RankLoad load;
+
+// Sent by a slave process to ask for work, together with the cost of the chunk it has just finished
+struct TaskRequest
+{
+    int workID;      // Process ID
+    int done;        // The number of tasks in the last chunk, 0 for the first request
+    double seconds;  // The time spent on the last chunk
+    long long count; // The solutions of the last chunk, taken by the master process with --speculate
+};
+
+// The result of a puzzle in batch mode
+struct PuzzleResult
+{
+    long long count;   // The number of solutions
+    double seconds;    // The time spent on the puzzle
+    struct Task first; // With --cache, the first solution found, packed by PackMap, for the result cache of the master process
+};
+
+// Sent by a slave process in batch mode instead of struct TaskRequest, the results of the chunk of puzzles it has just finished, followed
+// by the results themselves
+struct BatchReport
+{
+    long long first;                             // The index of the first puzzle of the chunk, see struct TaskChunk
+    int count;                                   // The number of puzzles in the chunk, 0 for the first request
+    double seconds;                              // The time spent on the chunk
+    struct PuzzleResult results[MAX_CHUNK_TASKS];
+};
+
+// A chunk of consecutive tasks [first, first + count) handed out by the master process, followed by the task records themselves. When the
+// tasks are the records of a puzzle corpus mapped by every process, first is the index of the record and the records are not sent.
+struct TaskChunk
+{
+    long long first;
+    int count;
+    struct Task tasks[MAX_CHUNK_TASKS];
+};
+
+// With --speculate, a chunk handed out to a slave process, see TrackChunk
+struct ChunkRecord
+{
+    int first;       // The index of its first task in the work queue
+    int count;       // The number of tasks
+    double deadline; // The time after which it is overdue
+    int copies;      // The number of processes working on it
+    int done;        // 1 once a process finished it, the results of the other copy are dropped
+    int split;       // 1 if its process gave part of it away, so it can not be handed out again as a whole
+};
+
+// State of the work queue, only used by the master process
+struct TaskQueue
+{
+    struct Task *tasks;     // The tasks produced by SolverSplit, followed by the tasks donated by busy processes
+    int next;               // The next task index to hand out
+    int taskNum;            // The number of tasks
+    int capacity;           // The number of tasks which fit in tasks[]
+    int comm_sz;            // The number of processes
+    int threads;            // The number of worker threads per process
+    int tasksMeasured;      // The number of tasks whose cost has been reported by the slave processes
+    double secondsMeasured; // The time spent on these tasks
+    int *state;             // RANK_BUSY, RANK_WAITING or RANK_STOPPED for each slave process
+    int *stealPending;      // 1 if a TAG_STEAL message to the slave process has not been answered yet
+    double *stealRetry;     // The time before which the slave process is not asked to give away work again
+    int busy;               // The number of slave processes in RANK_BUSY
+    int waiting;            // The number of slave processes in RANK_WAITING
+    int steals;             // The number of TAG_STEAL messages not answered yet
+    int donated;            // The number of tasks given away by busy processes
+    long long origin;       // The index of tasks[0] in the puzzle corpus
+    int shared;             // 1 if tasks[] is the puzzle corpus mapped by every process, the task records are not sent
+    struct ChunkRecord *chunks; // With --speculate, every chunk handed out, NULL otherwise
+    int chunkNum;               // The number of chunks
+    int chunkCapacity;          // The number of chunks which fit in chunks[]
+    int *current;               // With --speculate, the index in chunks[] of the chunk of each slave process, -1 if it has none
+    int *discard;               // With --speculate, 1 if the process gave away part of a chunk which runs elsewhere too, see FinishChunk
+    long long solved;           // With --speculate, the solutions of the chunks, each taken from the process which finished it first
+    int speculated;             // The number of chunks handed out again
+    int duplicates;             // The number of results dropped since another process finished the chunk first
+};
+
+static struct TaskQueue queue;
+
+// The puzzle corpus of the batch mode, mapped by every process when --batch=FILE is one
+static struct Corpus corpus;
+
+// With --find, the solutions found by the searches of the process (all its threads) and not reported yet, see RecordSolution
+static atomic_llong unreported;
+
+// With --find, the number of solutions the master process knows of, its own and the ones reported with TAG_FOUND
+static long long foundTotal;
+
+// The options of the MPI program, copied into the struct Params of every process
+static struct Params defaultParams = {0, 0, TASKS_PER_PROCESS, 1, NULL, NULL, NULL, NULL, NULL, NULL, CHECKPOINT_SECONDS, 0, 0};
+
+// With --serve, the solutions kept by the process for the reply to the current request (--print=N), see RecordSolution
+static struct Task *keptSolutions;
+static int keepMax;
+static atomic_int keptNum;
+
+// With --checkpoint, the solutions of the tasks the process has finished, and a copy of the task it is solving when running is 1
+static long long solutionsDone;
+static struct Task runningTask;
+static int running;
+
+// With --checkpoint, the time of the next checkpoint of the master process, 1 in checkpointNow once SIGTERM asks for a last one, and 1 in
+// checkpointing while the master process collects one, no work is handed out meanwhile
+static double nextCheckpoint;
+static volatile sig_atomic_t checkpointNow;
+static int checkpointing;
+
+// The header of the checkpoints, and the solutions of the work done before a restart
+static struct CheckpointHeader checkpointHeader;
+static long long restoredSolutions;
+
+// Sent by a slave process in answer to TAG_CHECKPOINT, followed by the tasks themselves
+struct CheckpointReply
+{
+    long long count;                                           // The solutions found by the process so far, see LeftWork
+    int n;                                                     // The number of tasks
+    struct Task tasks[MAX_CHUNK_TASKS + SOLVER_FRONTIER_MAX]; // The work the process has left
 };
 
 /*
- * Function: GetLevel 
+ * Function: ParseOption 
+ * --------------------
+ * Read an option of the MPI program, the solver options are read by ParseSolverOptions
+ * --tasks-per-process=N: split the puzzle into about N tasks per process (default 16)
+ * --threads=N: hybrid mode, every process solves its tasks with a pool of N worker threads (default 1, no pool)
+ * --batch=FILE: solve every puzzle of FILE ("-" for stdin) instead of the puzzle on the command line, see sudoku_io.h
+ * --solutions=FILE: every process writes the solutions it finds to FILE.rank, and FILE gets the count of every process
+ * --report=FILE: write the load of every process to FILE in JSON, see ReportLoad
+ * --serve=PATH: keep running and solve the puzzles sent to the Unix-domain socket PATH, see sudoku_serve.h
+ * --cache[=FILE]: with --batch or --serve, the master process answers the puzzles it has seen, up to their symmetries, from the result
+ *                 cache, kept in FILE across runs when it is given, see sudoku_cache.h
+ * --checkpoint=FILE: write the state of the count to FILE every --checkpoint-interval=SECONDS (default 600) and on SIGTERM, see
+ *                    sudoku_checkpoint.h
+ * --restart: resume the count from the checkpoint FILE
+ * --speculate: hand the chunks which run far longer than expected out again to the waiting processes, the first result is taken. It
+ *              is not fault tolerance, a process which dies still ends the job, see Speculate
+ * 
+ * arg: the option
+ * 
+ * returns: return 1 if arg is an option of the MPI program, otherwise, return 0
+*/
+int ParseOption(const char *arg)
+{
+    if (strncmp(arg, "--tasks-per-process=", 20) == 0)
+    {
+        defaultParams.tasksPerProcess = atoi(arg + 20);
+        return defaultParams.tasksPerProcess > 0;
+    }
+    if (strncmp(arg, "--threads=", 10) == 0)
+    {
+        defaultParams.threads = atoi(arg + 10);
+        return defaultParams.threads > 0;
+    }
+    if (strncmp(arg, "--batch=", 8) == 0 && arg[8] != '\0')
+    {
+        defaultParams.batch = arg + 8;
+        return 1;
+    }
+    if (strncmp(arg, "--solutions=", 12) == 0 && arg[12] != '\0')
+    {
+        defaultParams.solutions = arg + 12;
+        return 1;
+    }
+    if (strncmp(arg, "--report=", 9) == 0 && arg[9] != '\0')
+    {
+        defaultParams.report = arg + 9;
+        return 1;
+    }
+    if (strncmp(arg, "--serve=", 8) == 0 && arg[8] != '\0')
+    {
+        defaultParams.serve = arg + 8;
+        return 1;
+    }
+    if (strcmp(arg, "--cache") == 0 || (strncmp(arg, "--cache=", 8) == 0 && arg[8] != '\0'))
+    {
+        defaultParams.cache = arg[7] == '=' ? arg + 8 : "";
+        return 1;
+    }
+    if (strncmp(arg, "--checkpoint=", 13) == 0 && arg[13] != '\0')
+    {
+        defaultParams.checkpoint = arg + 13;
+        return 1;
+    }
+    if (strncmp(arg, "--checkpoint-interval=", 22) == 0)
+    {
+        defaultParams.checkpointInterval = atof(arg + 22);
+        return defaultParams.checkpointInterval > 0;
+    }
+    if (strcmp(arg, "--restart") == 0)
+    {
+        defaultParams.restart = 1;
+        return 1;
+    }
+    if (strcmp(arg, "--speculate") == 0)
+    {
+        defaultParams.speculate = 1;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Function: AddResults 
+ * --------------------
+ * The function of the MPI_Op ResultSum, add every field of the struct Result records in invec to the ones in inoutvec
+ * 
+ * invec, inoutvec: arrays of struct Result
+ * len: the number of records
+ * datatype: ResultType
+*/
+void AddResults(void *invec, void *inoutvec, int *len, MPI_Datatype *datatype)
+{
+    (void)datatype;
+    struct Result *in = invec;
+    struct Result *inout = inoutvec;
+    for (int i = 0; i < *len; i++)
+    {
+        inout[i].count += in[i].count;
+        inout[i].nodes += in[i].nodes;
+        inout[i].propagated += in[i].propagated;
+        inout[i].tasks += in[i].tasks;
+    }
+}
+
+/*
+ * Function: CreateResultType 
+ * --------------------
+ * Describe struct Result to MPI as ResultType, its 64-bit counters and its int, without the padding, and create the ResultSum operation
+*/
+void CreateResultType()
+{
+    int blocklengths[2] = {3, 1};
+    MPI_Aint displacements[2] = {offsetof(struct Result, count), offsetof(struct Result, tasks)};
+    MPI_Datatype types[2] = {MPI_LONG_LONG, MPI_INT};
+    MPI_Datatype type;
+    MPI_Type_create_struct(2, blocklengths, displacements, types, &type);
+    // The extent must cover the padding at the end, in case several records are reduced at once
+    MPI_Type_create_resized(type, 0, sizeof(struct Result), &ResultType);
+    MPI_Type_free(&type);
+    MPI_Type_commit(&ResultType);
+    MPI_Op_create(AddResults, 1, &ResultSum);
+}
+
+/*
+ * Function: CollectResults 
+ * --------------------
+ * Add up the results of all the processes at the master process, in a reduction tree rather than one message per process
+ * 
+ * struct Result *result: the result of the current process
+ * 
+ * returns: the sum over all the processes, only meaningful in the master process
+*/
+struct Result CollectResults(struct Result *result)
+{
+    struct Result total = {0, 0, 0, 0};
+    load.count += result->count;
+    load.tasks += result->tasks;
+    double start = MPI_Wtime();
+    MPI_Reduce(result, &total, 1, ResultType, ResultSum, 0, MPI_COMM_WORLD);
+    load.blockedSeconds += MPI_Wtime() - start;
+    return total;
+}
+
+/*
+ * Function: RecordTasks 
+ * --------------------
+ * Add the time of solved tasks to the load of the process
+ * 
+ * double seconds: the time spent on them
+ * double slowest: the time of the longest of them, 0 if it is not known
+*/
+void RecordTasks(double seconds, double slowest)
+{
+    load.solveSeconds += seconds;
+    if (slowest > load.slowestTask)
+    {
+        load.slowestTask = slowest;
+    }
+}
+
+/*
+ * Function: SudokuSolutionWithTask 
+ * --------------------
+ * Unpack the task produced by SolverSplit, namely the sudoku map with its first blank cells filled, then call SudokuSolution function
+ * to calculate the number of solutions
+ * 
+ * const struct Task *task: the task
+ * 
+ * returns: the solutions to the sudoku found in the task
+*/
+long long SudokuSolutionWithTask(const struct Task *task)
+{
+    char map[SUDOKU_CELLS];
+    double start = MPI_Wtime();
+    UnpackMap(task->grid, map);
+    runningTask = *task;
+    running = 1;
+    long long count = SudokuSolution(map);
+    running = 0;
+    solutionsDone += count;
+    double seconds = MPI_Wtime() - start;
+    RecordTasks(seconds, seconds);
+    return count;
+}
+
+/*
+ * Function: LeftWork 
+ * --------------------
+ * Describe the work a process has left for a checkpoint: the running search as SolverFrontier sees it, or the whole running task
+ * when the search can not be described, followed by the tasks which are not started yet
+ * 
+ * const struct Task *rest: the tasks not started yet
+ * int nrest: the number of them
+ * struct Task *tasks: filled with the work left, room for nrest + SOLVER_FRONTIER_MAX tasks
+ * long long *count: set to the solutions of the tasks the process finished and of the running search so far
+ * 
+ * returns: the number of tasks
+*/
+int LeftWork(const struct Task *rest, int nrest, struct Task *tasks, long long *count)
+{
+    int n = 0;
+    long long partial = 0;
+    if (running)
+    {
+        n = SolverFrontier(tasks, &partial);
+        if (n < 0)
+        {
+            // The DLX backend and the representatives of --symmetry start the task over after a restart
+            tasks[0] = runningTask;
+            n = 1;
+            partial = 0;
+        }
+    }
+    memcpy(tasks + n, rest, nrest * sizeof(struct Task));
+    *count = solutionsDone + partial;
+    return n + nrest;
+}
+
+/*
+ * Function: GetChunkSize 
+ * --------------------
+ * Decide how many tasks the master process hands out in the next chunk. Until a cost has been reported the chunk is a single task,
+ * afterwards it is the number of tasks which take about CHUNK_SECONDS at the average cost observed so far, for each of the worker
+ * threads of a process, since the reported time is the sum over the threads. The chunk never takes more
+ * than half of a fair share of the remaining tasks, so that the last tasks are still spread over all the slave processes.
+ * 
+ * returns: the number of tasks in the next chunk, 0 if there is no task left
+*/
+int GetChunkSize()
+{
+    int remaining = queue.taskNum - queue.next;
+    if (remaining <= 0)
+    {
+        return 0;
+    }
+    int chunk = 1;
+    if (queue.tasksMeasured > 0 && queue.secondsMeasured > 0)
+    {
+        double perTask = queue.secondsMeasured / queue.tasksMeasured;
+        chunk = (int)(CHUNK_SECONDS / perTask * queue.threads);
+    }
+    else if (queue.tasksMeasured > 0)
+    {
+        // The tasks done so far were too cheap to be measured
+        chunk = remaining;
+    }
+    int limit = remaining / (2 * queue.comm_sz);
+    if (chunk > limit)
+    {
+        chunk = limit;
+    }
+    if (chunk > MAX_CHUNK_TASKS)
+    {
+        chunk = MAX_CHUNK_TASKS;
+    }
+    if (chunk < 1)
+    {
+        chunk = 1;
+    }
+    return chunk;
+}
+
+/*
+ * Function: AddTasks 
+ * --------------------
+ * Append tasks given away by a busy process to the work queue
+ * 
+ * const struct Task *tasks: the tasks
+ * int n: the number of tasks
+*/
+void AddTasks(const struct Task *tasks, int n)
+{
+    // Once the searches are cancelled the tasks given away are dropped
+    if (SolverCancelled())
+    {
+        return;
+    }
+    if (queue.taskNum + n > queue.capacity)
+    {
+        int capacity = 2 * (queue.taskNum + n);
+        struct Task *grown = realloc(queue.tasks, capacity * sizeof(struct Task));
+        if (!grown)
+        {
+            printf("Out of memory for the work queue!\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        queue.tasks = grown;
+        queue.capacity = capacity;
+    }
+    memcpy(queue.tasks + queue.taskNum, tasks, n * sizeof(struct Task));
+    queue.taskNum += n;
+    queue.donated += n;
+}
+
+/*
+ * Function: TrackChunk 
+ * --------------------
+ * With --speculate, record the chunk handed out to a slave process, with the deadline after which Speculate may hand it out again
+ * 
+ * int dest: the rank of the slave process
+ * int first: the index of its first task in the work queue
+ * int count: the number of tasks
+*/
+void TrackChunk(int dest, int first, int count)
+{
+    if (queue.chunkNum == queue.chunkCapacity)
+    {
+        int capacity = 2 * queue.chunkCapacity + 64;
+        struct ChunkRecord *grown = realloc(queue.chunks, capacity * sizeof(struct ChunkRecord));
+        if (!grown)
+        {
+            printf("Out of memory for the chunk records!\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        queue.chunks = grown;
+        queue.chunkCapacity = capacity;
+    }
+    double expected = queue.tasksMeasured > 0 ? SPECULATE_FACTOR * count * queue.secondsMeasured / queue.tasksMeasured : 0;
+    struct ChunkRecord *record = &queue.chunks[queue.chunkNum];
+    record->first = first;
+    record->count = count;
+    record->deadline = MPI_Wtime() + (expected > SPECULATE_SECONDS ? expected : SPECULATE_SECONDS);
+    record->copies = 1;
+    record->done = 0;
+    record->split = 0;
+    queue.current[dest] = queue.chunkNum++;
+    queue.discard[dest] = 0;
+}
+
+/*
+ * Function: SendChunk 
+ * --------------------
+ * Send the next chunk of tasks to a slave process, an empty chunk tells it to stop
+ * 
+ * int dest: the rank of the slave process
+ * int stop: 1 to send an empty chunk
+*/
+void SendChunk(int dest, int stop)
+{
+    static struct TaskChunk chunk;
+    chunk.first = queue.origin + queue.next;
+    chunk.count = stop ? 0 : GetChunkSize();
+    int records = queue.shared ? 0 : chunk.count;
+    memcpy(chunk.tasks, queue.tasks + queue.next, records * sizeof(struct Task));
+    if (queue.chunks && chunk.count > 0)
+    {
+        TrackChunk(dest, queue.next, chunk.count);
+    }
+    queue.next += chunk.count;
+    queue.state[dest] = chunk.count > 0 ? RANK_BUSY : RANK_STOPPED;
+    if (chunk.count > 0)
+    {
+        queue.busy++;
+    }
+    // Only the task records of the chunk are sent
+    MPI_Send(&chunk, offsetof(struct TaskChunk, tasks) + records * sizeof(struct Task), MPI_BYTE, dest, TAG_WORK, MPI_COMM_WORLD);
+}
+
+/*
+ * Function: Overdue 
+ * --------------------
+ * returns: 1 if the chunk of the slave process can be handed out again by Speculate: it is past its deadline, it has not been finished,
+ *          and its process has not given any of it away, 0 otherwise
+*/
+int Overdue(int rank, double now)
+{
+    int c = queue.current[rank];
+    if (queue.state[rank] != RANK_BUSY || c < 0)
+    {
+        return 0;
+    }
+    const struct ChunkRecord *record = &queue.chunks[c];
+    return !record->done && !record->split && record->copies == 1 && now >= record->deadline;
+}
+
+/*
+ * Function: Speculate 
+ * --------------------
+ * With --speculate, hand the overdue chunks out again to the waiting slave processes, so a process slowed down by a busy node, or
+ * which does not even answer TAG_STEAL, does not hold the end of the run. A chunk runs on two processes at most, the first result
+ * is taken and the other process is told to drop the chunk with TAG_DROP, see FinishChunk. This is not fault tolerance: a process
+ * which dies still ends the job, continuing without it would need the fault-tolerant extension of MPI (ULFM), which is not used.
+*/
+void Speculate()
+{
+    static struct TaskChunk chunk;
+    double now = MPI_Wtime();
+    for (int i = 1; i < queue.comm_sz && queue.waiting > 0; i++)
+    {
+        if (!Overdue(i, now))
+        {
+            continue;
+        }
+        int dest = 1;
+        while (queue.state[dest] != RANK_WAITING)
+        {
+            dest++;
+        }
+        struct ChunkRecord *record = &queue.chunks[queue.current[i]];
+        chunk.first = queue.origin + record->first;
+        chunk.count = record->count;
+        memcpy(chunk.tasks, queue.tasks + record->first, record->count * sizeof(struct Task));
+        record->copies++;
+        queue.current[dest] = queue.current[i];
+        queue.discard[dest] = 0;
+        queue.state[dest] = RANK_BUSY;
+        queue.waiting--;
+        queue.busy++;
+        queue.speculated++;
+        MPI_Send(&chunk, offsetof(struct TaskChunk, tasks) + chunk.count * sizeof(struct Task), MPI_BYTE, dest, TAG_WORK, MPI_COMM_WORLD);
+    }
+}
+
+/*
+ * Function: FinishChunk 
+ * --------------------
+ * With --speculate, take the result of the chunk a slave process has just finished, unless another process finished it first or the
+ * process gave part of it away while it ran elsewhere too. The other process still working on the chunk is told to drop it. The count
+ * comes from TaskRequest.count, which only slave() fills in: slavePool has no count per chunk, so main rejects --speculate with --threads.
+ * 
+ * int rank: the rank of the slave process
+ * long long count: the solutions of its chunk
+*/
+void FinishChunk(int rank, long long count)
+{
+    int c = queue.current[rank];
+    if (c < 0)
+    {
+        return;
+    }
+    struct ChunkRecord *record = &queue.chunks[c];
+    queue.current[rank] = -1;
+    record->copies--;
+    if (record->done || queue.discard[rank])
+    {
+        queue.duplicates++;
+        return;
+    }
+    record->done = 1;
+    queue.solved += count;
+    for (int i = 1; i < queue.comm_sz && record->copies > 0; i++)
+    {
+        if (queue.current[i] == c)
+        {
+            long long first = queue.origin + record->first;
+            MPI_Send(&first, 1, MPI_LONG_LONG, i, TAG_DROP, MPI_COMM_WORLD);
+        }
+    }
+}
+
+/*
+ * Function: Rebalance 
+ * --------------------
+ * Hand out the queued tasks to the waiting slave processes, and when the queue is empty, hand out the overdue chunks again (Speculate),
+ * then ask busy slave processes to give away part of their work, at most one TAG_STEAL message per waiting process
+*/
+void Rebalance()
+{
+    // The chunks handed out during a checkpoint would belong to neither side of it
+    if (checkpointing)
+    {
+        return;
+    }
+    for (int i = 1; i < queue.comm_sz && queue.waiting > 0 && queue.next < queue.taskNum; i++)
+    {
+        if (queue.state[i] == RANK_WAITING)
+        {
+            queue.waiting--;
+            SendChunk(i, 0);
+        }
+    }
+    if (queue.waiting == 0 || queue.next < queue.taskNum || SolverCancelled())
+    {
+        return;
+    }
+    if (queue.chunks)
+    {
+        Speculate();
+    }
+    double now = MPI_Wtime();
+    for (int i = 1; i < queue.comm_sz && queue.steals < queue.waiting; i++)
+    {
+        // A chunk which runs on two processes, or is already finished, must stay whole
+        int whole = queue.chunks && queue.current[i] >= 0 &&
+                    (queue.chunks[queue.current[i]].copies > 1 || queue.chunks[queue.current[i]].done);
+        if (queue.state[i] == RANK_BUSY && !queue.stealPending[i] && now >= queue.stealRetry[i] && !whole)
+        {
+            MPI_Send(NULL, 0, MPI_BYTE, i, TAG_STEAL, MPI_COMM_WORLD);
+            queue.stealPending[i] = 1;
+            queue.steals++;
+        }
+    }
+}
+
+/*
+ * Function: RecordSolution 
+ * --------------------
+ * Installed as SolverConfig.onSolution with --find, --solutions or --print, called by any thread of the process: count the solution for
+ * --find, add it to the solution file of the process, and keep the first ones for the reply of the solver service
+ * 
+ * map[]: the solution
+*/
+void RecordSolution(char map[])
+{
+    if (SolverConfig.limit > 0)
+    {
+        atomic_fetch_add(&unreported, 1);
+    }
+    if (defaultParams.solutions)
+    {
+        SolutionsWrite(map);
+    }
+    if (keepMax > 0)
+    {
+        int i = atomic_fetch_add(&keptNum, 1);
+        if (i < keepMax)
+        {
+            PackMap(map, keptSolutions[i].grid);
+        }
+    }
+}
+
+/*
+ * Function: ReportFound 
+ * --------------------
+ * Send the solutions found by a slave process since its last report to the master process, called before every request for work and
+ * at the poll points of the search, so the master process learns about them while the search is still running
+*/
+void ReportFound()
+{
+    long long n = atomic_exchange(&unreported, 0);
+    if (n > 0)
+    {
+        MPI_Send(&n, 1, MPI_LONG_LONG, 0, TAG_FOUND, MPI_COMM_WORLD);
+    }
+}
+
+/*
+ * Function: AddFound 
+ * --------------------
+ * Add solutions to the ones known by the master process. When the number asked by --find is reached, stop the searches of the master
+ * process, drop the tasks which have not been handed out, and send TAG_CANCEL to every slave process. The slave processes then finish
+ * their chunks at once and ask for work, so the usual end of the work queue follows.
+ * 
+ * long long n: the number of new solutions
+*/
+void AddFound(long long n)
+{
+    foundTotal += n;
+    if (SolverConfig.limit == 0 || foundTotal < SolverConfig.limit || SolverCancelled())
+    {
+        return;
+    }
+    SolverCancel();
+    queue.next = queue.taskNum;
+    for (int i = 1; i < queue.comm_sz; i++)
+    {
+        MPI_Send(NULL, 0, MPI_BYTE, i, TAG_CANCEL, MPI_COMM_WORLD);
+    }
+}
+
+/*
+ * Function: ServeMessage 
+ * --------------------
+ * Receive a message of a slave process and update the work queue
+ * TAG_REQUEST: record the cost of the chunk it finished, and its result with --speculate (FinishChunk), and reply with its next chunk
+ *              of tasks, or let it wait if the queue is empty
+ * TAG_DONATE: add the tasks it gave away to the queue
+ * TAG_FOUND: add the solutions it found, see AddFound
+ * 
+ * MPI_Status *status: the status of the pending message, from MPI_Probe or MPI_Iprobe
+*/
+void ServeMessage(MPI_Status *status)
+{
+    int source = status->MPI_SOURCE;
+    if (status->MPI_TAG == TAG_REQUEST)
+    {
+        struct TaskRequest request;
+        MPI_Recv(&request, sizeof(request), MPI_BYTE, source, TAG_REQUEST, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        queue.tasksMeasured += request.done;
+        queue.secondsMeasured += request.seconds;
+        if (queue.chunks)
+        {
+            FinishChunk(source, request.count);
+        }
+        if (queue.state[source] == RANK_BUSY)
+        {
+            queue.busy--;
+        }
+        if (queue.next < queue.taskNum && !checkpointing)
+        {
+            SendChunk(source, 0);
+        }
+        else
+        {
+            queue.state[source] = RANK_WAITING;
+            queue.waiting++;
+        }
+    }
+    else if (status->MPI_TAG == TAG_FOUND)
+    {
+        long long n;
+        MPI_Recv(&n, 1, MPI_LONG_LONG, source, TAG_FOUND, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        AddFound(n);
+    }
+    else
+    {
+        static struct Task donated[MAX_CHUNK_TASKS];
+        int bytes;
+        MPI_Get_count(status, MPI_BYTE, &bytes);
+        MPI_Recv(donated, sizeof(donated), MPI_BYTE, source, TAG_DONATE, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        int n = bytes / sizeof(struct Task);
+        queue.stealPending[source] = 0;
+        queue.steals--;
+        if (n == 0)
+        {
+            queue.stealRetry[source] = MPI_Wtime() + STEAL_RETRY_SECONDS;
+        }
+        // With --speculate, the tasks given away from a chunk which runs elsewhere too, or is finished, are dropped: the other copy
+        // counts them, and the result of this one is dropped as well. Otherwise the chunk can not be handed out again as a whole.
+        if (n > 0 && queue.chunks && queue.current[source] >= 0)
+        {
+            struct ChunkRecord *record = &queue.chunks[queue.current[source]];
+            if (record->copies > 1 || record->done)
+            {
+                queue.discard[source] = 1;
+                n = 0;
+            }
+            else
+            {
+                record->split = 1;
+            }
+        }
+        AddTasks(donated, n);
+    }
+    Rebalance();
+}
+
+/*
+ * Function: CheckpointDue 
+ * --------------------
+ * returns: 1 if the master process should take a checkpoint now, the interval has passed or SIGTERM asked for one
+*/
+int CheckpointDue(void)
+{
+    return defaultParams.checkpoint && !checkpointing && !SolverCancelled() && (checkpointNow || MPI_Wtime() >= nextCheckpoint);
+}
+
+/*
+ * Function: KeepTasks 
+ * --------------------
+ * Append tasks to the work left of the checkpoint being collected
+ * 
+ * struct Task **tasks: the growing array of the work left
+ * long long *n: the number of tasks in it
+ * long long *capacity: its capacity
+ * const struct Task *more: the tasks to append
+ * long long m: the number of them
+*/
+void KeepTasks(struct Task **tasks, long long *n, long long *capacity, const struct Task *more, long long m)
+{
+    if (*n + m > *capacity)
+    {
+        long long grown = 2 * (*n + m);
+        struct Task *larger = realloc(*tasks, grown * sizeof(struct Task));
+        if (!larger)
+        {
+            printf("Out of memory for the checkpoint!\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        *tasks = larger;
+        *capacity = grown;
+    }
+    memcpy(*tasks + *n, more, m * sizeof(struct Task));
+    *n += m;
+}
+
+/*
+ * Function: TakeCheckpoint 
+ * --------------------
+ * Write the state of the count to the --checkpoint file. No chunk is handed out while every slave process is asked for its work
+ * left with TAG_CHECKPOINT, the other messages are served meanwhile, so the tasks given away before the answer of a process are in
+ * the queue, and the chunks handed out before the request are in its answer. The solutions of the work done by every process and
+ * the work left of all of them together are written by CheckpointWrite. After a checkpoint asked for by SIGTERM the run stops.
+*/
+void TakeCheckpoint(void)
+{
+    static struct CheckpointReply reply;
+    double start = MPI_Wtime();
+    struct Task *tasks = NULL;
+    long long n = 0;
+    long long capacity = 0;
+    long long solutions;
+    checkpointing = 1;
+    for (int i = 1; i < queue.comm_sz; i++)
+    {
+        MPI_Send(NULL, 0, MPI_BYTE, i, TAG_CHECKPOINT, MPI_COMM_WORLD);
+    }
+    // The work left of the master process itself, its own search is stopped at a poll point
+    reply.n = LeftWork(NULL, 0, reply.tasks, &solutions);
+    KeepTasks(&tasks, &n, &capacity, reply.tasks, reply.n);
+    for (int replies = 1; replies < queue.comm_sz;)
+    {
+        MPI_Status status;
+        MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        if (status.MPI_TAG != TAG_CHECKPOINT)
+        {
+            ServeMessage(&status);
+            continue;
+        }
+        MPI_Recv(&reply, sizeof(reply), MPI_BYTE, status.MPI_SOURCE, TAG_CHECKPOINT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        solutions += reply.count;
+        KeepTasks(&tasks, &n, &capacity, reply.tasks, reply.n);
+        replies++;
+    }
+    KeepTasks(&tasks, &n, &capacity, queue.tasks + queue.next, queue.taskNum - queue.next);
+    checkpointHeader.solutions = restoredSolutions + solutions;
+    if (CheckpointWrite(defaultParams.checkpoint, &checkpointHeader, tasks, n))
+    {
+        printf("Checkpoint %s: %lld solutions found, %lld tasks left, written in %.3f s.\n", defaultParams.checkpoint,
+               (long long)checkpointHeader.solutions, n, MPI_Wtime() - start);
+        fflush(stdout);
+    }
+    free(tasks);
+    checkpointing = 0;
+    nextCheckpoint = MPI_Wtime() + defaultParams.checkpointInterval;
+    if (checkpointNow)
+    {
+        printf("Stopped by SIGTERM, resume with --restart.\n");
+        fflush(stdout);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    Rebalance();
+}
+
+/*
+ * Function: RequestCheckpoint 
+ * --------------------
+ * The SIGTERM handler with --checkpoint: the master process takes a last checkpoint at its next poll point and stops the run, the
+ * slave processes keep working until it does
+ * 
+ * int signum: SIGTERM
+*/
+void RequestCheckpoint(int signum)
+{
+    (void)signum;
+    checkpointNow = 1;
+}
+
+/*
+ * Function: ServePendingMessages 
+ * --------------------
+ * Serve all the messages which have already arrived, without blocking. It is also installed as SolverConfig.onPoll while the master
+ * process works on a task itself, so the slave processes never wait for the master process longer than SOLVER_POLL_INTERVAL search nodes.
+ * When slave processes are waiting and the queue is empty, the master process gives away part of its own task too, or in the hybrid
+ * mode the tasks its workers have not started, asking them to give away part of their search when there is none. With --checkpoint it
+ * also takes the checkpoints which are due.
+*/
+void ServePendingMessages(void)
+{
+    int flag = 1;
+    MPI_Status status;
+    if (SolverConfig.limit > 0)
+    {
+        AddFound(atomic_exchange(&unreported, 0));
+    }
+    if (CheckpointDue())
+    {
+        TakeCheckpoint();
+    }
+    while (flag)
+    {
+        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
+        if (flag)
+        {
+            ServeMessage(&status);
+        }
+    }
+    if (queue.waiting > 0 && queue.next == queue.taskNum && !SolverCancelled())
+    {
+        static struct Task donated[MAX_CHUNK_TASKS];
+        int n;
+        if (queue.threads > 1)
+        {
+            n = PoolTakeBack(donated, MAX_CHUNK_TASKS);
+            if (n == 0)
+            {
+                PoolAskDonation();
+            }
+        }
+        else
+        {
+            n = SolverDonate(donated, SUDOKU_SIZE);
+        }
+        if (n > 0)
+        {
+            AddTasks(donated, n);
+            Rebalance();
+        }
+    }
+}
+
+// The chunk a slave process is working on, and the index of the task being solved, SlavePoll gives away the tasks after it
+static struct TaskChunk slaveChunk;
+static int slaveCurrent;
+
+// 1 once TAG_DROP told the slave process that another process finished its chunk first (--speculate)
+static int slaveDropped;
+
+/*
+ * Function: SendCheckpoint 
+ * --------------------
+ * Answer TAG_CHECKPOINT with the solutions found by the slave process so far and the work it has left, see LeftWork
+ * 
+ * const struct Task *rest: the tasks of its chunk which are not started yet
+ * int nrest: the number of them
+*/
+void SendCheckpoint(const struct Task *rest, int nrest)
+{
+    static struct CheckpointReply reply;
+    reply.n = LeftWork(rest, nrest, reply.tasks, &reply.count);
+    MPI_Send(&reply, offsetof(struct CheckpointReply, tasks) + reply.n * sizeof(struct Task), MPI_BYTE, 0, TAG_CHECKPOINT, MPI_COMM_WORLD);
+}
+
+/*
+ * Function: SlavePoll 
+ * --------------------
+ * Installed as SolverConfig.onPoll in the slave processes. When the master process asks for work with TAG_STEAL, give away the tasks of
+ * the chunk which have not been started yet, or else the untried values near the top of the search stack (SolverDonate). The answer is
+ * always sent, possibly with no task. With --find, also report the solutions found so far, and stop the search on TAG_CANCEL. With
+ * --checkpoint, answer TAG_CHECKPOINT with the work left (SendCheckpoint), and with --speculate stop the search on TAG_DROP for the
+ * current chunk. The messages are served in the order they were sent, so the tasks given away before a checkpoint are never in its
+ * answer too.
+*/
+void SlavePoll(void)
+{
+    int flag = 1;
+    MPI_Status status;
+    if (SolverConfig.limit > 0)
+    {
+        ReportFound();
+    }
+    while (flag)
+    {
+        MPI_Iprobe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
+        if (!flag)
+        {
+            break;
+        }
+        if (status.MPI_TAG == TAG_CANCEL)
+        {
+            MPI_Recv(NULL, 0, MPI_BYTE, 0, TAG_CANCEL, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            SolverCancel();
+        }
+        else if (status.MPI_TAG == TAG_CHECKPOINT)
+        {
+            MPI_Recv(NULL, 0, MPI_BYTE, 0, TAG_CHECKPOINT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            SendCheckpoint(slaveChunk.tasks + slaveCurrent + 1, slaveChunk.count - slaveCurrent - 1);
+        }
+        else if (status.MPI_TAG == TAG_DROP)
+        {
+            // The search stops, and the rest of the chunk is skipped
+            long long first;
+            MPI_Recv(&first, 1, MPI_LONG_LONG, 0, TAG_DROP, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            if (first == slaveChunk.first)
+            {
+                slaveDropped = 1;
+                SolverCancel();
+            }
+        }
+        else if (status.MPI_TAG == TAG_STEAL)
+        {
+            MPI_Recv(NULL, 0, MPI_BYTE, 0, TAG_STEAL, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            static struct Task donated[MAX_CHUNK_TASKS];
+            int n = slaveChunk.count - slaveCurrent - 1;
+            if (n > 0)
+            {
+                memcpy(donated, slaveChunk.tasks + slaveCurrent + 1, n * sizeof(struct Task));
+                slaveChunk.count = slaveCurrent + 1;
+            }
+            else
+            {
+                n = SolverDonate(donated, MAX_CHUNK_TASKS);
+            }
+            MPI_Send(donated, n * sizeof(struct Task), MPI_BYTE, 0, TAG_DONATE, MPI_COMM_WORLD);
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+/*
+ * Function: slavePool 
+ * --------------------
+ * The slave process in the hybrid mode. The main thread does all the MPI calls (MPI_THREAD_FUNNELED): it asks the master process for a
+ * chunk once every worker thread is idle and the pool is empty, pushes the chunk into the pool, and answers TAG_STEAL with the tasks
+ * the workers have not started, half of them at most. Meanwhile the workers share their tasks through the pool (sudoku_pool.c), and
+ * their results are added up before the single result of the process is sent.
+ * 
+ * struct Params workInfo: the basic infomation of the process, including workID, threads
+*/
+void slavePool(struct Params workInfo)
+{
+    struct Result result = {0, 0, 0, 0};
+    struct TaskRequest request = {workInfo.workID, 0, 0, 0};
+    static struct TaskChunk chunk;
+    static struct Task donated[MAX_CHUNK_TASKS];
+    struct timespec pause = {0, POLL_NANOSECONDS};
+    int requested = 0;
+    double requestedAt = 0;
+    if (!PoolStart(workInfo.threads, &SolverConfig))
+    {
+        printf("Failed to start %d threads!\n", workInfo.threads);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    while (1)
+    {
+        int flag;
+        MPI_Status status;
+        MPI_Iprobe(0, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
+        if (flag && status.MPI_TAG == TAG_STEAL)
+        {
+            MPI_Recv(NULL, 0, MPI_BYTE, 0, TAG_STEAL, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            int n = PoolTakeBack(donated, (PoolSize() + 1) / 2);
+            if (n == 0)
+            {
+                PoolAskDonation();
+            }
+            MPI_Send(donated, n * sizeof(struct Task), MPI_BYTE, 0, TAG_DONATE, MPI_COMM_WORLD);
+        }
+        else if (flag && status.MPI_TAG == TAG_CANCEL)
+        {
+            // The workers return from their searches, and the tasks left in the pool are dropped as they are taken
+            MPI_Recv(NULL, 0, MPI_BYTE, 0, TAG_CANCEL, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            SolverCancel();
+        }
+        else if (flag && status.MPI_TAG == TAG_WORK)
+        {
+            MPI_Recv(&chunk, sizeof(chunk), MPI_BYTE, 0, TAG_WORK, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            // Every worker was idle from the request to the chunk
+            load.blockedSeconds += MPI_Wtime() - requestedAt;
+            requested = 0;
+            if (chunk.count == 0)
+            {
+                break;
+            }
+            PoolPush(chunk.tasks, chunk.count);
+        }
+        else
+        {
+            PoolBalance();
+            ReportFound();
+            if (!requested && PoolFinished())
+            {
+                // request.count stays 0, the workers only report their total, see FinishChunk
+                PoolTiming(&request.done, &request.seconds);
+                RecordTasks(request.seconds, 0);
+                requestedAt = MPI_Wtime();
+                MPI_Send(&request, sizeof(request), MPI_BYTE, 0, TAG_REQUEST, MPI_COMM_WORLD);
+                requested = 1;
+            }
+            else
+            {
+                nanosleep(&pause, NULL);
+            }
+        }
+    }
+    result.count = PoolStop(&SolverTotals, &result.tasks);
+    RecordTasks(0, PoolSlowestTask());
+    result.nodes = SolverTotals.nodes;
+    result.propagated = SolverTotals.propagated;
+    printf("workID is %d, the number of solutions is %lld, the number of tasks is %d, the number of threads is %d, the number of search nodes is %lld, the number of cells filled by propagation is %lld!\n",
+           workInfo.workID, result.count, result.tasks, workInfo.threads, result.nodes, result.propagated);
+    CollectResults(&result);
+}
+
+/*
+ * Function: slave 
+ * --------------------
+ * When my_rank != 0, the process asks the master process (namely my_rank = 0) for chunks of tasks until there is no task left, calculates the
+ * possible solutions to sudoku puzzle for each task, and finally sends its calculating results to the master process. While it works, the
+ * master process may ask it to give away part of its work to an idle process (SlavePoll).
+ * 
+ * struct Params workInfo: the basic infomation used to devide the computing workload to multiple processes, including workID, comm_sz
+ * 
+ * returns: the  number of the solutions to the sudoku puzzle calculated by each slave process seperately
+*/
+void slave(struct Params workInfo)
+{
+    struct Result result = {0, 0, 0, 0};
+    struct TaskRequest request = {workInfo.workID, 0, 0, 0};
+    SolverConfig.onPoll = SlavePoll;
+    while (1)
+    {
+        ReportFound();
+        double waited = MPI_Wtime();
+        MPI_Send(&request, sizeof(request), MPI_BYTE, 0, TAG_REQUEST, MPI_COMM_WORLD);
+        // A TAG_STEAL message sent before the master process got the request is answered with no task, TAG_CANCEL stops the searches
+        // of the chunks still to come, a checkpoint finds no work left, and TAG_DROP is too late for the chunk already finished
+        MPI_Status status;
+        MPI_Recv(&slaveChunk, sizeof(slaveChunk), MPI_BYTE, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        while (status.MPI_TAG != TAG_WORK)
+        {
+            if (status.MPI_TAG == TAG_STEAL)
+            {
+                MPI_Send(NULL, 0, MPI_BYTE, 0, TAG_DONATE, MPI_COMM_WORLD);
+            }
+            else if (status.MPI_TAG == TAG_CHECKPOINT)
+            {
+                SendCheckpoint(NULL, 0);
+            }
+            else if (status.MPI_TAG == TAG_CANCEL)
+            {
+                SolverCancel();
+            }
+            MPI_Recv(&slaveChunk, sizeof(slaveChunk), MPI_BYTE, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        }
+        load.blockedSeconds += MPI_Wtime() - waited;
+        if (slaveChunk.count == 0)
+        {
+            break;
+        }
+        double start = MPI_Wtime();
+        request.count = 0;
+        for (slaveCurrent = 0; slaveCurrent < slaveChunk.count && !slaveDropped; slaveCurrent++)
+        {
+            request.count += SudokuSolutionWithTask(&slaveChunk.tasks[slaveCurrent]);
+        }
+        if (slaveDropped)
+        {
+            // Another process finished the chunk first, its result is the one taken
+            SolverResume();
+            slaveDropped = 0;
+        }
+        result.count += request.count;
+        result.tasks += slaveChunk.count;
+        request.done = slaveChunk.count;
+        request.seconds = MPI_Wtime() - start;
+    }
+    SolverConfig.onPoll = NULL;
+    result.nodes = SolverTotals.nodes;
+    result.propagated = SolverTotals.propagated;
+    printf("workID is %d, the number of solutions is %lld, the number of tasks is %d, the number of search nodes is %lld, the number of cells filled by propagation is %lld!\n",
+           workInfo.workID, result.count, result.tasks, result.nodes, result.propagated);
+    CollectResults(&result);
+}
+
+/*
+ * Function: SpeculationDue 
+ * --------------------
+ * returns: 1 if Speculate would hand an overdue chunk out to a waiting slave process now (--speculate), otherwise, return 0
+*/
+int SpeculationDue(void)
+{
+    if (!queue.chunks || queue.waiting == 0 || queue.next < queue.taskNum)
+    {
+        return 0;
+    }
+    double now = MPI_Wtime();
+    for (int i = 1; i < queue.comm_sz; i++)
+    {
+        if (Overdue(i, now))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Function: ProbeMessage 
+ * --------------------
+ * Wait for the next message to the idle master process, like MPI_Probe. With --checkpoint the wait also ends when a checkpoint is due,
+ * so the checkpoints are taken while the slave processes work on the last tasks, and with --speculate when a waiting process can take
+ * an overdue chunk, since the process working on it may not send anything for a long time.
+ * 
+ * MPI_Status *status: set to the status of the pending message
+ * 
+ * returns: 1 if a message is pending, 0 if a checkpoint or a chunk is due
+*/
+int ProbeMessage(MPI_Status *status)
+{
+    if (!defaultParams.checkpoint && !queue.chunks)
+    {
+        MPI_Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, status);
+        return 1;
+    }
+    struct timespec pause = {0, POLL_NANOSECONDS};
+    int flag = 0;
+    while (!flag && !CheckpointDue() && !SpeculationDue())
+    {
+        MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, status);
+        if (!flag)
+        {
+            nanosleep(&pause, NULL);
+        }
+    }
+    return flag;
+}
+
+/*
+ * Function: master 
+ * --------------------
+ * When my_rank = 0, it splits the sudoku puzzle into about comm_sz * tasksPerProcess tasks with SolverSplit, and hands them out to the slave
+ * processes on demand, in chunks whose size follows the cost of the tasks reported by the slave processes, so a slave process which got cheap
+ * tasks simply asks again instead of idling. Between the requests the master process works on single tasks itself, with comm_sz = 1 it
+ * does all of them. When the queue runs dry while some processes are still busy, the idle processes wait and the busy ones are asked to
+ * give away the untried branches near the top of their search, so a long subtree is split while it runs. In the hybrid mode the master
+ * process feeds its own worker threads with a chunk whenever they are all idle, instead of working on single tasks. Once every process is idle, it
+ * adds up the calculating results of all the processes with MPI_Reduce to get the final number of the solutions to sudoku puzzle. With
+ * --symmetry the tasks are split from the representatives of SolverRepresentatives, and the total is multiplied by the size of their classes.
+ * With --checkpoint the state of the count is written every interval (TakeCheckpoint) and once more at the end, and with --restart the
+ * queue starts from the work left by the checkpoint instead of the split, the solutions of the work done before are added to the total.
+ * 
+ * struct Params workInfo: the basic infomation of the master process, including comm_sz, tasksPerProcess
+ * char *map: sudoku map array
+ * 
+ * returns: the total number of the solutions to the sudoku puzzle, at most the limit of --find
+*/
+long long master(struct Params workInfo, char map[])
+{
+    struct Result result = {0, 0, 0, 0};
+    int symmetric = SolverConfig.symmetry && !SolverConfig.onSolution;
+    CheckpointInit(&checkpointHeader, map, symmetric, workInfo.comm_sz);
+    if (workInfo.restart)
+    {
+        // The work left by the checkpoint takes the place of the split, the solutions of the work done are added at the end
+        struct CheckpointHeader saved;
+        queue.tasks = CheckpointRead(workInfo.checkpoint, &saved);
+        if (!queue.tasks)
+        {
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        if (memcmp(&saved.puzzle, &checkpointHeader.puzzle, sizeof(struct Task)) != 0 || saved.symmetry != checkpointHeader.symmetry)
+        {
+            printf("The checkpoint %s is not one of this puzzle with these options!\n", workInfo.checkpoint);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        queue.taskNum = saved.count;
+        restoredSolutions = saved.solutions;
+        printf("Restarting from %s, written by %u processes: %lld solutions found, %d tasks left.\n", workInfo.checkpoint,
+               saved.ranks, restoredSolutions, queue.taskNum);
+    }
+    else
+    {
+        queue.tasks = SolverSplit(map, &SolverConfig, workInfo.comm_sz * workInfo.tasksPerProcess, &queue.taskNum);
+        printf("The puzzle is split into %d tasks.\n", queue.taskNum);
+    }
+    nextCheckpoint = MPI_Wtime() + workInfo.checkpointInterval;
+    queue.capacity = queue.taskNum;
+    queue.next = 0;
+    queue.comm_sz = workInfo.comm_sz;
+    queue.threads = workInfo.threads;
+    queue.tasksMeasured = 0;
+    queue.secondsMeasured = 0;
+    queue.state = calloc(workInfo.comm_sz, sizeof(int));
+    queue.stealPending = calloc(workInfo.comm_sz, sizeof(int));
+    queue.stealRetry = calloc(workInfo.comm_sz, sizeof(double));
+    // Every slave process is counted as busy until its first request
+    queue.busy = workInfo.comm_sz - 1;
+    queue.waiting = 0;
+    queue.steals = 0;
+    queue.donated = 0;
+    queue.chunks = NULL;
+    queue.chunkNum = 0;
+    queue.chunkCapacity = 0;
+    queue.solved = 0;
+    queue.speculated = 0;
+    queue.duplicates = 0;
+    if (workInfo.speculate)
+    {
+        queue.chunkCapacity = workInfo.comm_sz * workInfo.tasksPerProcess;
+        queue.chunks = malloc(queue.chunkCapacity * sizeof(struct ChunkRecord));
+        queue.current = malloc(workInfo.comm_sz * sizeof(int));
+        queue.discard = calloc(workInfo.comm_sz, sizeof(int));
+        for (int i = 0; i < workInfo.comm_sz; i++)
+        {
+            queue.current[i] = -1;
+        }
+    }
+
+    // Work on single tasks while serving the messages, then only serve them until every slave process is waiting for work
+    struct timespec pause = {0, POLL_NANOSECONDS};
+    if (workInfo.threads > 1 && !PoolStart(workInfo.threads, &SolverConfig))
+    {
+        printf("Failed to start %d threads!\n", workInfo.threads);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    SolverConfig.onPoll = workInfo.threads > 1 ? NULL : ServePendingMessages;
+    while (1)
+    {
+        ServePendingMessages();
+        if (workInfo.threads > 1)
+        {
+            int done;
+            double seconds;
+            PoolTiming(&done, &seconds);
+            RecordTasks(seconds, 0);
+            queue.tasksMeasured += done;
+            queue.secondsMeasured += seconds;
+            PoolBalance();
+            if (queue.next < queue.taskNum && PoolFinished())
+            {
+                int n = GetChunkSize();
+                PoolPush(queue.tasks + queue.next, n);
+                queue.next += n;
+            }
+            else if (queue.next == queue.taskNum && queue.busy == 0 && queue.steals == 0 && PoolFinished())
+            {
+                break;
+            }
+            else
+            {
+                nanosleep(&pause, NULL);
+            }
+        }
+        else if (queue.next < queue.taskNum)
+        {
+            result.count += SudokuSolutionWithTask(&queue.tasks[queue.next++]);
+            result.tasks++;
+        }
+        // A TAG_STEAL message may still be answered by a process which finished its chunk meanwhile
+        else if (queue.busy > 0 || queue.steals > 0)
+        {
+            MPI_Status status;
+            double waited = MPI_Wtime();
+            if (queue.waiting <= queue.steals || queue.busy == 0)
+            {
+                int flag = ProbeMessage(&status);
+                load.blockedSeconds += MPI_Wtime() - waited;
+                if (flag)
+                {
+                    ServeMessage(&status);
+                }
+                else
+                {
+                    Rebalance();
+                }
+            }
+            else
+            {
+                // Some waiting process has no TAG_STEAL message out for it, ask again once a retry time has passed
+                int flag = 0;
+                double until = MPI_Wtime() + STEAL_RETRY_SECONDS;
+                while (!flag && MPI_Wtime() < until)
+                {
+                    MPI_Iprobe(MPI_ANY_SOURCE, MPI_ANY_TAG, MPI_COMM_WORLD, &flag, &status);
+                }
+                load.blockedSeconds += MPI_Wtime() - waited;
+                if (flag)
+                {
+                    ServeMessage(&status);
+                }
+                else
+                {
+                    Rebalance();
+                }
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+    SolverConfig.onPoll = NULL;
+    if (workInfo.threads > 1)
+    {
+        result.count += PoolStop(&SolverTotals, &result.tasks);
+        RecordTasks(0, PoolSlowestTask());
+    }
+
+    // Every slave process is waiting, every TAG_STEAL message is answered and the queue is empty, tell them to stop
+    for (int i = 1; i < workInfo.comm_sz; i++)
+    {
+        SendChunk(i, 1);
+    }
+    printf("The number of tasks given away by busy processes is %d.\n", queue.donated);
+    if (queue.chunks)
+    {
+        printf("The number of chunks handed out again is %d, the number of their results dropped is %d.\n", queue.speculated,
+               queue.duplicates);
+    }
+    free(queue.tasks);
+    free(queue.state);
+    free(queue.stealPending);
+    free(queue.stealRetry);
+
+    // Add up the calculating results of all the processes, including its own
+    result.nodes = SolverTotals.nodes;
+    result.propagated = SolverTotals.propagated;
+    struct Result total = CollectResults(&result);
+    printf("The number of tasks solved is %d, the number of search nodes is %lld, the number of cells filled by propagation is %lld.\n",
+           total.tasks, total.nodes, total.propagated);
+    // With --speculate the counts of the slave processes include the chunks solved twice, every chunk is counted once by the master process
+    if (queue.chunks)
+    {
+        total.count = result.count + queue.solved;
+        free(queue.chunks);
+        free(queue.current);
+        free(queue.discard);
+        queue.chunks = NULL;
+    }
+    total.count += restoredSolutions;
+    // The last checkpoint has no work left, a restart from it only reports the count
+    if (workInfo.checkpoint)
+    {
+        checkpointHeader.solutions = total.count;
+        CheckpointWrite(workInfo.checkpoint, &checkpointHeader, NULL, 0);
+    }
+    if (symmetric)
+    {
+        long long factor = SolverSymmetryFactor(map);
+        printf("Every solution of the tasks stands for %lld solutions of the puzzle (--symmetry).\n", factor);
+        total.count *= factor;
+    }
+    // With --find every process stops at the limit on its own, so the sum can be above it, like the serial count it is clamped
+    if (SolverConfig.limit > 0 && total.count > SolverConfig.limit)
+    {
+        total.count = SolverConfig.limit;
+    }
+    return total.count;
+}
+
+/*
+ * Function: slaveBatch 
+ * --------------------
+ * The slave process in batch mode, it asks the master process for chunks of whole puzzles until there is no puzzle left, and sends the
+ * number of solutions and the time of every puzzle of a chunk together with its next request. With a puzzle corpus the chunk is only a
+ * range of records, which are read in place from the mapping of the corpus. With --cache the first solution of every puzzle is sent too.
+ * 
+ * struct Params workInfo: the basic infomation of the process, including workID
+*/
+void slaveBatch(struct Params workInfo)
+{
+    struct Result result = {0, 0, 0, 0};
+    static struct BatchReport report;
+    static struct TaskChunk chunk;
+    static struct Task firsts[MAX_CHUNK_TASKS];
+    long long counts[MAX_CHUNK_TASKS];
+    double seconds[MAX_CHUNK_TASKS];
+    report.count = 0;
+    while (1)
+    {
+        double waited = MPI_Wtime();
+        MPI_Send(&report, offsetof(struct BatchReport, results) + report.count * sizeof(struct PuzzleResult), MPI_BYTE, 0, TAG_REQUEST, MPI_COMM_WORLD);
+        MPI_Recv(&chunk, sizeof(chunk), MPI_BYTE, 0, TAG_WORK, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        load.blockedSeconds += MPI_Wtime() - waited;
+        if (chunk.count == 0)
+        {
+            break;
+        }
+        // With --cache the master process sends the puzzles of a corpus which are not in the cache, not ranges of the corpus
+        const struct Task *tasks = corpus.base && !workInfo.cache ? corpus.tasks + chunk.first : chunk.tasks;
+        double start = MPI_Wtime();
+        result.count += SudokuSolutionBatch(tasks, chunk.count, counts, seconds, workInfo.cache ? firsts : NULL);
+        for (int i = 0; i < chunk.count; i++)
+        {
+            report.results[i].count = counts[i];
+            report.results[i].seconds = seconds[i];
+            if (workInfo.cache)
+            {
+                report.results[i].first = firsts[i];
+            }
+            RecordTasks(seconds[i], seconds[i]);
+        }
+        report.first = chunk.first;
+        report.count = chunk.count;
+        report.seconds = MPI_Wtime() - start;
+        result.tasks += chunk.count;
+    }
+    result.nodes = SolverTotals.nodes;
+    result.propagated = SolverTotals.propagated;
+    // stdout only holds the puzzle lines written by the master process
+    fprintf(stderr, "workID is %d, the number of solutions is %lld, the number of puzzles is %d, the number of search nodes is %lld!\n",
+            workInfo.workID, result.count, result.tasks, result.nodes);
+    CollectResults(&result);
+}
+
+// The results of the puzzles of the current block in batch mode, by position in the block, and the position of every task of the queue
+static struct PuzzleResult *blockResults;
+static int *blockPosition;
+static int blockPending;
+
+// With --cache, the key of every task of the queue, and for every position of the block the position of the same puzzle (up to its
+// symmetries) whose result it takes, -1 if it is solved or answered by the cache itself
+static struct CacheKey *blockKeys;
+static int *blockSource;
+static int *blockOrder;
+
+/*
+ * Function: ServeBatchMessage 
+ * --------------------
+ * Receive the report of a slave process in batch mode, store the results of its chunk, and reply with its next chunk of puzzles, or let
+ * it wait if the block has no puzzle left to hand out
+ * 
+ * MPI_Status *status: the status of the pending message, from MPI_Probe or MPI_Iprobe
+*/
+void ServeBatchMessage(MPI_Status *status)
+{
+    static struct BatchReport report;
+    int source = status->MPI_SOURCE;
+    MPI_Recv(&report, sizeof(report), MPI_BYTE, source, TAG_REQUEST, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    for (int i = 0; i < report.count; i++)
+    {
+        blockResults[blockPosition[report.first - queue.origin + i]] = report.results[i];
+    }
+    blockPending -= report.count;
+    queue.tasksMeasured += report.count;
+    queue.secondsMeasured += report.seconds;
+    if (queue.next < queue.taskNum)
+    {
+        SendChunk(source, 0);
+    }
+    else
+    {
+        queue.state[source] = RANK_WAITING;
+        queue.waiting++;
+    }
+}
+
+/*
+ * Function: ServePendingBatchMessages 
+ * --------------------
+ * Serve all the reports which have already arrived, without blocking, installed as SolverConfig.onPoll while the master process works on
+ * a puzzle itself
+*/
+void ServePendingBatchMessages(void)
+{
+    int flag = 1;
+    MPI_Status status;
+    while (flag)
+    {
+        MPI_Iprobe(MPI_ANY_SOURCE, TAG_REQUEST, MPI_COMM_WORLD, &flag, &status);
+        if (flag)
+        {
+            ServeBatchMessage(&status);
+        }
+    }
+}
+
+/*
+ * Function: CompareBlockKeys 
+ * --------------------
+ * The comparison of qsort on blockOrder: by canonical form, then by task index, so the first task of a group of the same puzzle comes first
+ * 
+ * a, b: pointers to task indexes of the queue
+ * 
+ * returns: a negative, zero or positive number as the first task sorts before, with or after the second one
+*/
+int CompareBlockKeys(const void *a, const void *b)
+{
+    int i = *(const int *)a;
+    int j = *(const int *)b;
+    int order = memcmp(&blockKeys[i].canonical, &blockKeys[j].canonical, sizeof(struct Task));
+    return order != 0 ? order : i - j;
+}
+
+/*
+ * Function: LookupBlock 
+ * --------------------
+ * With --cache, take out of the queue of the block the puzzles answered by the result cache, and the ones which are the same puzzle as an
+ * earlier one of the block up to their symmetries, so that only one puzzle of every class is handed out. The keys of the tasks left stay
+ * in blockKeys, in the order of the queue.
+ * 
+ * n: the number of positions in the block
+ * 
+ * returns: the number of solutions of the puzzles answered by the cache
+*/
+long long LookupBlock(int n)
+{
+    char map[SUDOKU_CELLS];
+    long long solutions = 0;
+    long long count;
+    int kept = 0;
+    for (int i = 0; i < n; i++)
+    {
+        blockSource[i] = -1;
+    }
+    for (int i = 0; i < queue.taskNum; i++)
+    {
+        UnpackMap(queue.tasks[i].grid, map);
+        CacheMakeKey(map, &blockKeys[kept]);
+        if (CacheLookup(&blockKeys[kept], SolverConfig.limit, &count, NULL))
+        {
+            blockResults[blockPosition[i]].count = count;
+            blockResults[blockPosition[i]].seconds = 0;
+            solutions += count;
+        }
+        else
+        {
+            queue.tasks[kept] = queue.tasks[i];
+            blockPosition[kept++] = blockPosition[i];
+        }
+    }
+
+    // Sorted by canonical form, a puzzle takes the result of the first puzzle of its class
+    for (int i = 0; i < kept; i++)
+    {
+        blockOrder[i] = i;
+    }
+    qsort(blockOrder, kept, sizeof(int), CompareBlockKeys);
+    int unique = kept;
+    for (int i = 1, leader = kept > 0 ? blockOrder[0] : 0; i < kept; i++)
+    {
+        if (memcmp(&blockKeys[blockOrder[i]].canonical, &blockKeys[leader].canonical, sizeof(struct Task)) == 0)
+        {
+            blockSource[blockPosition[blockOrder[i]]] = blockPosition[leader];
+            unique--;
+        }
+        else
+        {
+            leader = blockOrder[i];
+        }
+    }
+    if (unique < kept)
+    {
+        int next = 0;
+        for (int i = 0; i < kept; i++)
+        {
+            if (blockSource[blockPosition[i]] < 0)
+            {
+                queue.tasks[next] = queue.tasks[i];
+                blockKeys[next] = blockKeys[i];
+                blockPosition[next++] = blockPosition[i];
+            }
+        }
+    }
+    queue.taskNum = unique;
+    return solutions;
+}
+
+/*
+ * Function: StoreBlock 
  * --------------------
- * Set three levels for the sudoku solution algorithm based on the setting for the number of MPI processes
- * level = 1, fill the first blank cell with [1, 9]; if comm_sz belongs to [3, 10]
- * level = 2, fill the first two blank cells with [1,9]; if comm_sz belongs to [11, 82]
- * level = 3, fill the first three blank cells with [1,9]; if comm_sz belongs to [83, 730]
- * Note, the limitation for 730 is set in the main function, actually there is a limitation in HPC too, which is less than 730.
+ * With --cache, add the results of the puzzles handed out from the block to the result cache, and give their results to the other puzzles
+ * of their class in the block
  * 
- * int comm_sz: The number of MPI processes
+ * n: the number of positions in the block
  * 
- * returns: level (1, 2, 3)
+ * returns: the number of solutions of the puzzles which took the result of another one
 */
-int GetLevel(int comm_sz)
+long long StoreBlock(int n)
 {
-    if (comm_sz >= 3 && comm_sz <= 10)
+    long long solutions = 0;
+    for (int i = 0; i < queue.taskNum; i++)
     {
-        return 1;
+        const struct PuzzleResult *solved = &blockResults[blockPosition[i]];
+        CacheInsert(&blockKeys[i], SolverConfig.limit, solved->count, solved->count > 0 ? &solved->first : NULL);
     }
-    if (comm_sz >= 11 && comm_sz <= 82)
+    for (int i = 0; i < n; i++)
     {
-        return 2;
+        if (blockSource[i] >= 0)
+        {
+            blockResults[i].count = blockResults[blockSource[i]].count;
+            blockResults[i].seconds = 0;
+            solutions += blockResults[i].count;
+        }
     }
-    return 3;
+    return solutions;
 }
 
 /*
- * Function: GetTaskNum 
+ * Function: masterBatch 
  * --------------------
- * Calculate the number of the tasks according to the value of variable "level"
- * level = 1, fill the first blank cell with [1, 9], there will be 9 tasks
- * level = 2, fill the first two blank cells with [1,9], there will be 81 tasks
- * level = 3, fill the first three blank cells with [1,9], there will be 729 tasks
+ * The master process in batch mode. It reads the puzzle file block by block, hands the puzzles of a block out in chunks on demand like
+ * the tasks of a single puzzle, works on groups of SOLVER_LANES puzzles itself between the reports, and once every puzzle of the block is solved, writes
+ * one line per puzzle to stdout in input order (PrintPuzzleResult). Finally it adds up the results of all the processes. A block of a
+ * puzzle corpus is a range of its records, which every process reads in place, so only the ranges and the results are sent. With --cache
+ * the puzzles of a block are looked up in the result cache first, and only one puzzle of every class of the same puzzles up to their
+ * symmetries is handed out (LookupBlock, StoreBlock).
  * 
- * int level: calculated by GetLevel function based on the value of comm_sz
+ * struct Params workInfo: the basic infomation of the master process, including comm_sz, batch
  * 
- * returns: the number of tasks
+ * returns: the total number of the solutions to all the puzzles
 */
-int GetTaskNum(int level)
+long long masterBatch(struct Params workInfo)
 {
-    if (level == 1)
+    struct Result result = {0, 0, 0, 0};
+    char map[SUDOKU_CELLS];
+    FILE *in = corpus.base ? NULL : OpenPuzzles(workInfo.batch);
+    if (!corpus.base && !in)
+    {
+        fprintf(stderr, "Can not open %s!\n", workInfo.batch);
+    }
+    // The puzzles left after the lookups in the result cache are not a range of the corpus any more, they are copied and sent
+    struct Task *buffer = corpus.base && !workInfo.cache ? NULL : malloc(BATCH_BLOCK * sizeof(struct Task));
+    queue.capacity = BATCH_BLOCK;
+    queue.shared = corpus.base != NULL && !workInfo.cache;
+    queue.comm_sz = workInfo.comm_sz;
+    queue.threads = 1;
+    queue.tasksMeasured = 0;
+    queue.secondsMeasured = 0;
+    queue.state = calloc(workInfo.comm_sz, sizeof(int));
+    queue.waiting = 0;
+    queue.busy = 0;
+    blockResults = malloc(BATCH_BLOCK * sizeof(struct PuzzleResult));
+    blockPosition = malloc(BATCH_BLOCK * sizeof(int));
+    unsigned char *blockValid = malloc(BATCH_BLOCK);
+    if (workInfo.cache)
+    {
+        blockKeys = malloc(BATCH_BLOCK * sizeof(struct CacheKey));
+        blockSource = malloc(BATCH_BLOCK * sizeof(int));
+        blockOrder = malloc(BATCH_BLOCK * sizeof(int));
+    }
+    long long index = 0;
+    long long puzzles = 0;
+    long long cached = 0;
+    SolverConfig.onPoll = ServePendingBatchMessages;
+    while (in || corpus.base)
+    {
+        int n = 0;
+        int status = PUZZLE_OK;
+        int screened = 0;
+        queue.taskNum = 0;
+        queue.next = 0;
+        if (corpus.base)
+        {
+            // The block is the next range of records of the corpus
+            n = corpus.count - index < BATCH_BLOCK ? corpus.count - index : BATCH_BLOCK;
+            if (workInfo.cache)
+            {
+                memcpy(buffer, corpus.tasks + index, n * sizeof(struct Task));
+                queue.tasks = buffer;
+                queue.origin = 0;
+            }
+            else
+            {
+                queue.tasks = (struct Task *)corpus.tasks + index;
+                queue.origin = index;
+            }
+            for (; queue.taskNum < n; queue.taskNum++)
+            {
+                blockPosition[queue.taskNum] = queue.taskNum;
+            }
+            status = index + n == corpus.count ? PUZZLE_END : PUZZLE_OK;
+        }
+        else
+        {
+            // Read a block, the lines which are not puzzles keep their position but are not handed out
+            queue.tasks = buffer;
+            queue.origin = 0;
+            while (n < BATCH_BLOCK && (status = ReadPuzzle(in, map)) != PUZZLE_END)
+            {
+                blockResults[n].count = -1;
+                blockResults[n].seconds = 0;
+                if (status == PUZZLE_OK)
+                {
+                    PackMap(map, queue.tasks[queue.taskNum].grid);
+                    blockPosition[queue.taskNum++] = n;
+                }
+                n++;
+            }
+            // The puzzles with conflicting givens have no solution, they are screened out of the block at once instead of being handed out
+            if (SolverCheckTasks(queue.tasks, queue.taskNum, blockValid) < queue.taskNum)
+            {
+                int kept = 0;
+                for (int i = 0; i < queue.taskNum; i++)
+                {
+                    if (blockValid[i])
+                    {
+                        queue.tasks[kept] = queue.tasks[i];
+                        blockPosition[kept++] = blockPosition[i];
+                    }
+                    else
+                    {
+                        blockResults[blockPosition[i]].count = 0;
+                    }
+                }
+                screened = queue.taskNum - kept;
+                queue.taskNum = kept;
+            }
+        }
+        if (n == 0)
+        {
+            break;
+        }
+        int valid = queue.taskNum;
+        if (workInfo.cache)
+        {
+            result.count += LookupBlock(n);
+            cached += valid - queue.taskNum;
+        }
+        blockPending = queue.taskNum;
+
+        // The processes which have been waiting since the last block get their chunk first
+        for (int i = 1; i < workInfo.comm_sz && queue.waiting > 0 && queue.next < queue.taskNum; i++)
+        {
+            if (queue.state[i] == RANK_WAITING)
+            {
+                queue.waiting--;
+                SendChunk(i, 0);
+            }
+        }
+        // The reports are also served after every group of puzzles of the master process, which may be too easy to reach onPoll
+        while (blockPending > 0)
+        {
+            if (queue.next < queue.taskNum)
+            {
+                // The master process takes one lockstep group of puzzles at a time
+                int first = queue.next;
+                int group = queue.taskNum - first < SOLVER_LANES ? queue.taskNum - first : SOLVER_LANES;
+                long long counts[SOLVER_LANES];
+                double seconds[SOLVER_LANES];
+                struct Task firsts[SOLVER_LANES];
+                queue.next += group;
+                result.count += SudokuSolutionBatch(&queue.tasks[first], group, counts, seconds, workInfo.cache ? firsts : NULL);
+                for (int i = 0; i < group; i++)
+                {
+                    struct PuzzleResult *own = &blockResults[blockPosition[first + i]];
+                    own->count = counts[i];
+                    own->seconds = seconds[i];
+                    if (workInfo.cache)
+                    {
+                        own->first = firsts[i];
+                    }
+                    RecordTasks(seconds[i], seconds[i]);
+                }
+                result.tasks += group;
+                blockPending -= group;
+                ServePendingBatchMessages();
+            }
+            else
+            {
+                MPI_Status probe;
+                double waited = MPI_Wtime();
+                MPI_Probe(MPI_ANY_SOURCE, TAG_REQUEST, MPI_COMM_WORLD, &probe);
+                load.blockedSeconds += MPI_Wtime() - waited;
+                ServeBatchMessage(&probe);
+            }
+        }
+        if (workInfo.cache)
+        {
+            result.count += StoreBlock(n);
+        }
+        for (int i = 0; i < n; i++)
+        {
+            PrintPuzzleResult(stdout, index + i + 1, blockResults[i].count, blockResults[i].seconds);
+        }
+        index += n;
+        puzzles += valid + screened;
+        if (status == PUZZLE_END)
+        {
+            break;
+        }
+    }
+    SolverConfig.onPoll = NULL;
+    if (in)
     {
-        return 9;
+        ClosePuzzles(in);
     }
-    if (level == 2)
+
+    // Every puzzle is solved, a slave process which has not sent its first request yet has no result to report, tell all of them to stop
+    for (int i = 1; i < workInfo.comm_sz; i++)
+    {
+        if (queue.state[i] != RANK_WAITING)
+        {
+            static struct BatchReport report;
+            double waited = MPI_Wtime();
+            MPI_Recv(&report, sizeof(report), MPI_BYTE, i, TAG_REQUEST, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            load.blockedSeconds += MPI_Wtime() - waited;
+        }
+        SendChunk(i, 1);
+    }
+    free(buffer);
+    free(queue.state);
+    free(blockResults);
+    free(blockPosition);
+    free(blockValid);
+    free(blockKeys);
+    free(blockSource);
+    free(blockOrder);
+
+    result.nodes = SolverTotals.nodes;
+    result.propagated = SolverTotals.propagated;
+    struct Result total = CollectResults(&result);
+    fprintf(stderr, "The number of puzzles is %lld, %lld of them are valid, the number of search nodes is %lld.\n", index, puzzles, total.nodes);
+    if (workInfo.cache)
     {
-        return 81;
+        long long hits, lookups, records;
+        CacheCounters(&hits, &lookups, &records);
+        fprintf(stderr, "The number of puzzles answered by the result cache or by an earlier puzzle of their block is %lld, the cache holds %lld puzzles.\n",
+                cached, records);
     }
-    return 729;
+    return total.count;
 }
 
 /*
- * Function: SudokuSolutionWithParams 
+ * Function: BroadcastRequest 
  * --------------------
- * Fill in the first several blank cells (Note: the number of blank cells filled in should equal to level variable.) with workInfo.param,
- * then call SudokuSolution function to calculate the number of solutions
+ * Send the next request of the solver service from the master process to every process. The slave processes wait for it without
+ * spinning in MPI: they test the broadcast and sleep POLL_NANOSECONDS in between, so an idle service leaves the cores to other jobs.
  * 
- * struct Params workInfo: the basic infomation used to devide the computing workload to multiple processes, including workID, comm_sz, level, taskNum, param[3]
- * char *map: sudoku map array
+ * struct ServeRequest *request: the request, filled in the master process, received in the slave processes
+*/
+void BroadcastRequest(struct ServeRequest *request)
+{
+    struct timespec pause = {0, POLL_NANOSECONDS};
+    MPI_Request pending;
+    int done;
+    MPI_Ibcast(request, sizeof(*request), MPI_BYTE, 0, MPI_COMM_WORLD, &pending);
+    MPI_Test(&pending, &done, MPI_STATUS_IGNORE);
+    while (!done)
+    {
+        nanosleep(&pause, NULL);
+        MPI_Test(&pending, &done, MPI_STATUS_IGNORE);
+    }
+}
+
+/*
+ * Function: SolveRequest 
+ * --------------------
+ * Solve the puzzle of a request of the solver service with every process, the same way as a puzzle given on the command line, with the
+ * solver options of the request. Afterwards the master process gathers the solutions kept by every process for --print=N.
+ * SolverTotals only counts the request while it is solved, so the results printed for it are its own, and the counters of the earlier
+ * requests are added back at the end for the load report of the whole service.
+ * 
+ * struct Params workInfo: the basic infomation of the process
+ * const struct ServeRequest *request: the request, the same in every process
+ * char *map: sudoku map array, only read by the master process
+ * struct Task **solutions: set to the solutions gathered by the master process, to be freed, NULL in the slave processes
+ * int *n: set to the number of solutions gathered
  * 
- * returns: the solutions to the sudoku calculated by the current process
+ * returns: the number of solutions in the master process, 0 in the slave processes
 */
-long long SudokuSolutionWithParams(struct Params workInfo, char *map)
+long long SolveRequest(struct Params workInfo, const struct ServeRequest *request, char map[], struct Task **solutions, int *n)
 {
-    if (!SudokuMapCheck(map))
+    long long count = 0;
+    struct SolverStats served = SolverTotals;
+    SolverTotals = (struct SolverStats){0, 0, 0, 0};
+    SolverConfig.backend = request->backend;
+    SolverConfig.order = request->order;
+    SolverConfig.propagate = request->propagate;
+    SolverConfig.limit = request->limit;
+    SolverConfig.symmetry = request->symmetry;
+    SolverConfig.onSolution = request->limit > 0 || request->print > 0 ? RecordSolution : NULL;
+    // The state left by the cancel of the last request with --find
+    SolverResume();
+    atomic_store(&unreported, 0);
+    foundTotal = 0;
+    keepMax = request->print;
+    keptSolutions = keepMax > 0 ? malloc(keepMax * sizeof(struct Task)) : NULL;
+    atomic_store(&keptNum, 0);
+    if (keepMax > 0 && !keptSolutions)
     {
-        return 0;
+        printf("Out of memory for the solutions!\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    if (workInfo.workID == 0)
+    {
+        count = master(workInfo, map);
+    }
+    else if (workInfo.threads > 1)
+    {
+        slavePool(workInfo);
+    }
+    else
+    {
+        slave(workInfo);
     }
-    int setCount = 0;
 
-    // Fill in the first several(workInfo.level) blank cells with workInfo.param
-    for (int i = 1; i < 10; i++)
+    *solutions = NULL;
+    *n = 0;
+    if (keepMax > 0)
     {
-        if (setCount == workInfo.level)
+        int kept = atomic_load(&keptNum) < keepMax ? atomic_load(&keptNum) : keepMax;
+        int *bytes = workInfo.workID == 0 ? malloc(2 * workInfo.comm_sz * sizeof(int)) : NULL;
+        int *offsets = bytes ? bytes + workInfo.comm_sz : NULL;
+        int size = kept * sizeof(struct Task);
+        MPI_Gather(&size, 1, MPI_INT, bytes, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (workInfo.workID == 0)
         {
-            break;
+            int total = 0;
+            for (int i = 0; i < workInfo.comm_sz; i++)
+            {
+                offsets[i] = total;
+                total += bytes[i];
+            }
+            *solutions = malloc(total > 0 ? total : 1);
+            *n = total / sizeof(struct Task);
+        }
+        MPI_Gatherv(keptSolutions, size, MPI_BYTE, *solutions, bytes, offsets, MPI_BYTE, 0, MPI_COMM_WORLD);
+        free(bytes);
+    }
+    free(keptSolutions);
+    keptSolutions = NULL;
+    keepMax = 0;
+    SolverTotals.nodes += served.nodes;
+    SolverTotals.propagated += served.propagated;
+    SolverTotals.backtracks += served.backtracks;
+    SolverTotals.checks += served.checks;
+    return count;
+}
+
+/*
+ * Function: masterServe 
+ * --------------------
+ * The master process of the solver service (--serve=PATH). It listens on the Unix-domain socket PATH and serves the clients one after
+ * the other: every request of a connection is read (ServeRead), broadcast to the slave processes, solved by all the processes with
+ * SolveRequest, and answered at once. A puzzle whose givens conflict gets 0 solutions without being broadcast, and with --cache a puzzle
+ * which asks for at most one solution is answered from the result cache when it can be. The request "shutdown" stops every process. The
+ * replies are described in sudoku_serve.h.
+ * 
+ * struct Params workInfo: the basic infomation of the master process, including serve
+*/
+void masterServe(struct Params workInfo)
+{
+    struct SolverOptions defaults = SolverConfig;
+    struct ServeRequest request;
+    char map[SUDOKU_CELLS];
+    int listener = ServeOpen(workInfo.serve);
+    if (listener < 0)
+    {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    // A client which leaves before its reply must not stop the service
+    signal(SIGPIPE, SIG_IGN);
+    printf("Serving on %s with %d processes.\n", workInfo.serve, workInfo.comm_sz);
+    fflush(stdout);
+    int running = 1;
+    while (running)
+    {
+        FILE *in, *out;
+        if (!ServeAccept(listener, &in, &out))
+        {
+            continue;
         }
-        for (int j = 1; j < 10; j++)
+        long long index = 0;
+        int status;
+        while ((status = ServeRead(in, &defaults, &request, map)) != SERVE_END)
         {
-            if (GetCellValue(i, j, map) == 0)
+            if (status == SERVE_SHUTDOWN)
+            {
+                running = 0;
+                break;
+            }
+            index++;
+            long long count = -1;
+            struct Task *solutions = NULL;
+            int n = 0;
+            struct CacheKey key;
+            // The cache keeps one solution per puzzle, a request for more of them is always solved
+            int cacheable = workInfo.cache && status == SERVE_PUZZLE && request.print <= 1;
+            char solution[SUDOKU_CELLS];
+            double start = GetTime();
+            if (cacheable)
+            {
+                CacheMakeKey(map, &key);
+            }
+            if (status == SERVE_PUZZLE && !SolverCheck(map))
+            {
+                count = 0;
+            }
+            else if (cacheable && CacheLookup(&key, request.limit, &count, request.print > 0 ? solution : NULL))
+            {
+                if (request.print > 0 && count > 0)
+                {
+                    solutions = malloc(sizeof(struct Task));
+                    PackMap(solution, solutions[0].grid);
+                    n = 1;
+                }
+            }
+            else if (status == SERVE_PUZZLE)
             {
-                SetCellValue(i, j, workInfo.param[setCount], map);
-                setCount++;
-                if (setCount == workInfo.level)
+                BroadcastRequest(&request);
+                count = SolveRequest(workInfo, &request, map, &solutions, &n);
+                if (cacheable)
                 {
-                    break;
+                    CacheInsert(&key, request.limit, count, n > 0 ? &solutions[0] : NULL);
                 }
             }
+            double end = GetTime();
+            // With --find the processes may have kept more solutions than were counted before the cancel reached them
+            n = n < request.print ? n : request.print;
+            n = n < count ? n : (int)count;
+            ServeReply(out, index, count, (end - start) / 1000, solutions, n > 0 ? n : 0);
+            free(solutions);
+            fflush(stdout);
         }
+        fclose(in);
+        fclose(out);
     }
-    if (setCount != workInfo.level)
+    request.command = SERVE_SHUTDOWN;
+    BroadcastRequest(&request);
+    ServeClose(listener, workInfo.serve);
+    printf("The service on %s is stopped.\n", workInfo.serve);
+}
+
+/*
+ * Function: slaveServe 
+ * --------------------
+ * The slave process of the solver service, it solves the puzzle of every request broadcast by the master process until the service is
+ * stopped
+ * 
+ * struct Params workInfo: the basic infomation of the process
+*/
+void slaveServe(struct Params workInfo)
+{
+    struct ServeRequest request;
+    while (1)
     {
-        if (!SudokuMapCheck(map))
+        BroadcastRequest(&request);
+        if (request.command == SERVE_SHUTDOWN)
         {
-            return 0;
+            break;
         }
-        return 1;
+        struct Task *solutions;
+        int n;
+        SolveRequest(workInfo, &request, NULL, &solutions, &n);
     }
-    //SudokuPrint(map);
-    // Call SudokuSolution function in sudoku_20211125.c to calculate the number of solutions after filling in the first several(workInfo.level) blank cells with workInfo.param
-    return SudokuSolution(map);
 }
 
 /*
- * Function: slave 
+ * Function: OpenSolutionFile 
  * --------------------
- * When my_rank != 0, all the processes calculte the possible solutions to sudoku puzzle and work as the senders, send the calculating results to the master process (namely my_rank = 0)
+ * Create the solution file of the process, FILE.rank for --solutions=FILE, a puzzle corpus with one record per solution (sudoku_io.h).
+ * Every process writes its own file while it searches, so the solutions never go through the master process.
  * 
- * struct Params workInfo: the basic infomation used to devide the computing workload to multiple processes, including workID, comm_sz, level, taskNum, param[3]
- * char *map: sudoku map array
+ * struct Params workInfo: the basic infomation of the process, including workID, solutions
  * 
- * returns: the  number of the solutions to the sudoku puzzle calculated by each slave process seperately
+ * returns: 1 if every process created its file, otherwise, return 0
 */
-void slave(struct Params workInfo, char map[])
+int OpenSolutionFile(struct Params workInfo)
 {
-    struct Result result;
-    result.workID = workInfo.workID;
-    result.count = 0;
-    int pall = workInfo.comm_sz - 1;
-    char curMap[81];
-    for (int cur_rank = workInfo.workID - 1; cur_rank < workInfo.taskNum; cur_rank += pall)
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.%d", workInfo.solutions, workInfo.workID);
+    int opened = SolutionsOpen(path);
+    if (!opened)
     {
-        memcpy(curMap, map, 81);
-        // The three for loops are used to generate the corresponding tasks (9, 81, 729)
-        // When workInfo.level = 1, assign 9 tasks (filling in the first blank cell with [1,9] to all the slave processes evenly), workInfo.param[0] is used to store the value for the first blank cell
-        // When workInfo.level = 2, assign 81 tasks (filling in the first two blank cells with [1,9]*[1,9] to all slave processes evenly), workInfo.param[0] and workInfo.param[1] are used to store the values for the first two blank cells
-        // When workInfo.level = 3, assign 729 tasks (filling in the first three blank cells with [1,9]*[1,9]*[1,9] to all slave processes evenly), workInfo.param[0], workInfo.param[1] and workInfo.param[2] are used to store the values for the first three blank cells
-        for (int i = 0; i < workInfo.level; i++)
-        {
-            int subNum = cur_rank;
-            int dev = 1;
-            for (int j = 0; j < i; j++)
-            {
-                dev = dev * 9;
-            }
-            workInfo.param[i] = subNum / dev % 9 + 1;
-        }
-        result.count += SudokuSolutionWithParams(workInfo, curMap);
+        fprintf(stderr, "Can not open %s!\n", path);
     }
-    printf("workID is %d, the number of solutions is %d!\n", workInfo.workID, result.count);
-    MPI_Send((char *)&result, MAX_STRING, MPI_CHAR, 0, 0, MPI_COMM_WORLD);
+    int everywhere;
+    MPI_Allreduce(&opened, &everywhere, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    return everywhere;
 }
 
 /*
- * Function: master 
+ * Function: WriteSolutionIndex 
+ * --------------------
+ * Close the solution file of the process, gather the number of solutions written by every process to the master process, and write them
+ * to the index file, one line "rank solutions file" per process. Reading the solution files in rank order gives every solution once.
+ * 
+ * struct Params workInfo: the basic infomation of the process, including workID, comm_sz, solutions
+*/
+void WriteSolutionIndex(struct Params workInfo)
+{
+    long long written = SolutionsClose();
+    long long *counts = workInfo.workID == 0 ? malloc(workInfo.comm_sz * sizeof(long long)) : NULL;
+    MPI_Gather(&written, 1, MPI_LONG_LONG, counts, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+    if (workInfo.workID != 0)
+    {
+        return;
+    }
+    FILE *index = fopen(workInfo.solutions, "w");
+    long long total = 0;
+    int failed = !index;
+    for (int i = 0; i < workInfo.comm_sz && index; i++)
+    {
+        // A process which failed to write its file is recorded with -1 solutions
+        fprintf(index, "%d %lld %s.%d\n", i, counts[i], workInfo.solutions, i);
+        failed |= counts[i] < 0;
+        total += counts[i] > 0 ? counts[i] : 0;
+    }
+    if (index && fclose(index) != 0)
+    {
+        failed = 1;
+    }
+    if (failed)
+    {
+        printf("Failed to write the solutions to %s!\n", workInfo.solutions);
+    }
+    else
+    {
+        printf("The %lld solutions are written to %d files, listed in %s.\n", total, workInfo.comm_sz, workInfo.solutions);
+    }
+    free(counts);
+}
+
+/*
+ * Function: WriteLoadJson 
  * --------------------
- * When my_rank = 0, it works as the receiver, waiting for the rest processes' calculating results, and add all of them to get the final number of the solutions to sudoku puzzle.
+ * Write the load of every process to a JSON file for --report=FILE
  * 
- * int comm_sz: the number of all the processes which is set in the PBS file when submitting the job
+ * const char *path: the file name
+ * const struct RankLoad loads[]: the load of every process, by rank
+ * int n: the number of processes
+ * int threads: the number of worker threads per process
  * 
- * returns: the total number of the solutions to the sudoku puzzle
+ * returns: 1 if the file is written, otherwise, return 0
 */
-long long master(int comm_sz)
+int WriteLoadJson(const char *path, const struct RankLoad loads[], int n, int threads)
 {
-    char buf[1024];
-    long long count = 0;
-    // Receive the rest processes' (from 1 to comm_sz-1) calculating results
-    for (int i = 1; i < comm_sz; i++)
+    FILE *out = fopen(path, "w");
+    if (!out)
     {
-        MPI_Recv(buf, MAX_STRING, MPI_CHAR, i, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        struct Result *ret = (struct Result *)buf;
-        count += ret->count;
+        return 0;
     }
-    return count;
+    fprintf(out, "{\n  \"processes\": %d,\n  \"threads\": %d,\n  \"ranks\": [\n", n, threads);
+    for (int i = 0; i < n; i++)
+    {
+        const struct RankLoad *l = &loads[i];
+        fprintf(out, "    {\"rank\": %d, \"solutions\": %lld, \"tasks\": %lld, \"nodes\": %lld, \"backtracks\": %lld, \"checks\": %lld, "
+                     "\"propagated\": %lld, \"solve_seconds\": %.6f, \"slowest_task_seconds\": %.6f, \"blocked_seconds\": %.6f, "
+                     "\"wall_seconds\": %.6f}%s\n",
+                i, l->count, l->tasks, l->nodes, l->backtracks, l->checks, l->propagated, l->solveSeconds, l->slowestTask,
+                l->blockedSeconds, l->wallSeconds, i + 1 < n ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    return fclose(out) == 0;
+}
+
+/*
+ * Function: Imbalance 
+ * --------------------
+ * The ratio of the largest value to the mean over the processes, 1 when the work is shared out evenly
+ * 
+ * const double values[]: one value per process
+ * int n: the number of processes
+ * 
+ * returns: max / mean, 1 if every value is 0
+*/
+double Imbalance(const double values[], int n)
+{
+    double max = 0;
+    double sum = 0;
+    for (int i = 0; i < n; i++)
+    {
+        sum += values[i];
+        max = values[i] > max ? values[i] : max;
+    }
+    return sum > 0 ? max * n / sum : 1;
+}
+
+/*
+ * Function: ReportLoad 
+ * --------------------
+ * Gather the load of every process at the master process and print how evenly it was shared out: the max / mean ratio of the tasks, the
+ * search nodes, the solving time and the time blocked in MPI, how the time of the processes splits between solving, MPI and the rest, and
+ * the stragglers, the processes which solved for more than STRAGGLER_RATIO times the mean. A high ratio of tasks or nodes with an even
+ * solving time points at the decomposition, a large share of MPI time at the communication, and many nodes per task at the solver.
+ * With --report=FILE the loads are also written to FILE in JSON.
+ * 
+ * struct Params workInfo: the basic infomation of the process, including workID, comm_sz, threads, batch, report
+ * double wallSeconds: the time the process spent from the start of its work
+*/
+void ReportLoad(struct Params workInfo, double wallSeconds)
+{
+    load.nodes = SolverTotals.nodes;
+    load.backtracks = SolverTotals.backtracks;
+    load.checks = SolverTotals.checks;
+    load.propagated = SolverTotals.propagated;
+    load.wallSeconds = wallSeconds;
+    int n = workInfo.comm_sz;
+    struct RankLoad *loads = workInfo.workID == 0 ? malloc(n * sizeof(struct RankLoad)) : NULL;
+    MPI_Gather(&load, sizeof(load), MPI_BYTE, loads, sizeof(load), MPI_BYTE, 0, MPI_COMM_WORLD);
+    if (workInfo.workID != 0)
+    {
+        return;
+    }
+
+    // stdout only holds the puzzle lines in batch mode
+    FILE *out = workInfo.batch ? stderr : stdout;
+    double *tasks = calloc(4 * n, sizeof(double));
+    if (!loads || !tasks)
+    {
+        fprintf(stderr, "Out of memory for the load report!\n");
+        free(loads);
+        free(tasks);
+        return;
+    }
+    double *nodes = tasks + n;
+    double *solve = nodes + n;
+    double *blocked = solve + n;
+    double solveSum = 0, blockedSum = 0, wallSum = 0, wallMax = 0, slowest = 0;
+    for (int i = 0; i < n; i++)
+    {
+        tasks[i] = loads[i].tasks;
+        nodes[i] = loads[i].nodes;
+        solve[i] = loads[i].solveSeconds;
+        blocked[i] = loads[i].blockedSeconds;
+        solveSum += solve[i];
+        blockedSum += blocked[i];
+        wallSum += loads[i].wallSeconds;
+        wallMax = loads[i].wallSeconds > wallMax ? loads[i].wallSeconds : wallMax;
+        slowest = loads[i].slowestTask > slowest ? loads[i].slowestTask : slowest;
+    }
+    fprintf(out, "Load balance over %d processes (max / mean): tasks %.2f, search nodes %.2f, solving time %.2f, time blocked in MPI %.2f.\n",
+            n, Imbalance(tasks, n), Imbalance(nodes, n), Imbalance(solve, n), Imbalance(blocked, n));
+    // The solving time is added over the worker threads, every thread of a process is counted for the whole wall time
+    double solving = wallSum > 0 ? solveSum / (wallSum * workInfo.threads) : 0;
+    double waiting = wallSum > 0 ? blockedSum / wallSum : 0;
+    double other = 1 - solving - waiting > 0 ? 1 - solving - waiting : 0;
+    fprintf(out, "Time of the processes: %.1f%% solving, %.1f%% blocked in MPI, %.1f%% other; the slowest task took %.4f s, %.1f%% of the run.\n",
+            100 * solving, 100 * waiting, 100 * other, slowest, wallMax > 0 ? 100 * slowest / wallMax : 0);
+    fprintf(out, "Stragglers (solving time above %.2f x mean):", STRAGGLER_RATIO);
+    int stragglers = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (solveSum > 0 && solve[i] * n > STRAGGLER_RATIO * solveSum)
+        {
+            fprintf(out, "%s rank %d (%.2f x, %.3f s)", stragglers ? "," : "", i, solve[i] * n / solveSum, solve[i]);
+            stragglers++;
+        }
+    }
+    fprintf(out, stragglers ? ".\n" : " none.\n");
+    if (workInfo.report && !WriteLoadJson(workInfo.report, loads, n, workInfo.threads))
+    {
+        fprintf(out, "Failed to write %s!\n", workInfo.report);
+    }
+    free(tasks);
+    free(loads);
 }
 
 int main(int argc, char **argv)
 {
-    char map[81];
+    char map[SUDOKU_CELLS];
+
+    // Read the options in front of the input for sudoku puzzle, every process parses the same argv
+    int optionCount = ParseSolverOptions(argc, argv, &SolverConfig, ParseOption);
+    if (optionCount < 0)
+    {
+        return 0;
+    }
+    argc -= optionCount;
+    argv += optionCount;
 
-    // Checking whether the input for sudoku puzzle is valid
-    if (!ParseArgv(argc, argv, map))
+    // Checking whether the input for sudoku puzzle is valid, in batch mode the puzzles are read from the file by the master process, and
+    // the solver service reads them from its socket
+    if (defaultParams.batch && defaultParams.threads > 1)
+    {
+        printf("--batch can not be combined with --threads!\n");
+        return 0;
+    }
+    if (defaultParams.batch && defaultParams.solutions)
+    {
+        printf("--batch can not be combined with --solutions!\n");
+        return 0;
+    }
+    if (defaultParams.serve && (defaultParams.batch || defaultParams.solutions))
+    {
+        printf("--serve can not be combined with --batch or --solutions!\n");
+        return 0;
+    }
+    // A single puzzle is split over the processes, its result is never looked up
+    if (defaultParams.cache && !defaultParams.batch && !defaultParams.serve)
+    {
+        printf("--cache needs --batch or --serve!\n");
+        return 0;
+    }
+    // A checkpoint describes the task queue and the search stacks of a single puzzle counted by single threaded processes
+    if (defaultParams.checkpoint && (defaultParams.batch || defaultParams.serve || defaultParams.threads > 1 || defaultParams.solutions ||
+                                     SolverConfig.limit > 0))
+    {
+        printf("--checkpoint can not be combined with --batch, --serve, --threads, --solutions or --find!\n");
+        return 0;
+    }
+    if (defaultParams.restart && !defaultParams.checkpoint)
+    {
+        printf("--restart needs --checkpoint!\n");
+        return 0;
+    }
+    // The master process takes the result of every chunk once, which needs the chunks of a single puzzle counted without visiting the
+    // solutions one by one
+    if (defaultParams.speculate && (defaultParams.batch || defaultParams.serve || defaultParams.threads > 1 || defaultParams.solutions ||
+                                    defaultParams.checkpoint || SolverConfig.limit > 0))
+    {
+        printf("--speculate can not be combined with --batch, --serve, --threads, --solutions, --checkpoint or --find!\n");
+        return 0;
+    }
+    if (!defaultParams.batch && !defaultParams.serve && !ParseArgv(argc, argv, map))
     {
         printf("Wrong input for Sudoku puzzle!\n");
         return 0;
@@ -201,38 +2504,124 @@ int main(int argc, char **argv)
     int comm_sz;
     int my_rank;
 
-    MPI_Init(NULL, NULL);
+    // In the hybrid mode only the main thread of each process makes MPI calls
+    if (defaultParams.threads > 1)
+    {
+        int provided;
+        MPI_Init_thread(NULL, NULL, MPI_THREAD_FUNNELED, &provided);
+        if (provided < MPI_THREAD_FUNNELED)
+        {
+            printf("The MPI library does not support MPI_THREAD_FUNNELED!\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    else
+    {
+        MPI_Init(NULL, NULL);
+    }
     MPI_Comm_size(MPI_COMM_WORLD, &comm_sz);
     MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
 
-    // Restriction for the setting of comm_sz
-    if (comm_sz <= 2 || comm_sz >= 730)
-    {
-        printf("Wrong setting for the number of processes!\n");
-        return 0;
-    }
+    CreateResultType();
 
     // Set the values for struct Params variable
-    struct Params workInfo;
+    struct Params workInfo = defaultParams;
     workInfo.workID = my_rank;
-    workInfo.level = GetLevel(comm_sz-1);
     workInfo.comm_sz = comm_sz;
-    workInfo.taskNum = GetTaskNum(workInfo.level);
 
-    // Master process, which is used to add the number of solutions to sudoku puzzle from each salve process, and evaluate the time cost for the whole program
-    if (my_rank == 0)
+    // With --find every process counts the solutions as they are found, so the master process can stop all the searches once enough
+    // are known. In batch mode the limit applies to every puzzle on its own. With --solutions every process writes its own file.
+    if (workInfo.solutions && !OpenSolutionFile(workInfo))
+    {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if ((SolverConfig.limit > 0 || workInfo.solutions) && !workInfo.batch)
+    {
+        SolverConfig.onSolution = RecordSolution;
+    }
+
+    // A batch file which is a puzzle corpus is mapped by every process, so the records do not have to be sent
+    if (workInfo.batch)
+    {
+        int mapped = strcmp(workInfo.batch, "-") != 0 && CorpusOpen(workInfo.batch, &corpus);
+        int everywhere, anywhere;
+        MPI_Allreduce(&mapped, &everywhere, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        MPI_Allreduce(&mapped, &anywhere, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+        if (anywhere && !everywhere)
+        {
+            if (my_rank == 0)
+            {
+                fprintf(stderr, "%s can not be mapped as a puzzle corpus by every process!\n", workInfo.batch);
+            }
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+
+    // The result cache lives in the master process, which looks the puzzles up before it hands them out
+    if (workInfo.cache && my_rank == 0 && !CacheOpen(workInfo.cache[0] != '\0' ? workInfo.cache : NULL))
+    {
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    // SIGTERM, as sent ahead of the end of a batch job, asks for a last checkpoint
+    if (workInfo.checkpoint)
+    {
+        signal(SIGTERM, RequestCheckpoint);
+    }
+
+    double begin = MPI_Wtime();
+
+    // The solver service keeps every process until a client stops it, each request is solved like a puzzle on the command line
+    if (workInfo.serve && my_rank == 0)
+    {
+        masterServe(workInfo);
+    }
+    else if (workInfo.serve)
+    {
+        slaveServe(workInfo);
+    }
+    // Master process, which splits the sudoku puzzle into tasks, hands them out, adds the number of solutions to sudoku puzzle from each salve process, and evaluate the time cost for the whole program
+    else if (my_rank == 0 && workInfo.batch)
+    {
+        double start = GetTime();
+        long long total_num_solutions = masterBatch(workInfo);
+        double end = GetTime();
+        fprintf(stderr, "The num of processes is %d, the num of solutions is %lld, total time is %.3f ms.\n", comm_sz, total_num_solutions, end - start);
+    }
+    else if (my_rank == 0)
     {
-       long long start = GetTime();
-       int total_num_solutions = master(comm_sz);
-       long long end = GetTime();
-       printf("The num of processes is %d, the num of solutions is %d, total time is %lld ms.\n", comm_sz - 1, total_num_solutions, end - start);
+       double start = GetTime();
+       long long total_num_solutions = master(workInfo, map);
+       double end = GetTime();
+       printf("The num of processes is %d, the num of solutions is %lld, total time is %.3f ms.\n", comm_sz, total_num_solutions, end - start);
+       PrintFindResult(stdout, total_num_solutions, SolverConfig.limit);
     }
     // Slave processes, which are used to calculate the number of solutions to sudoku puzzle seperately
+    else if (workInfo.batch)
+    {
+        slaveBatch(workInfo);
+    }
+    else if (workInfo.threads > 1)
+    {
+        slavePool(workInfo);
+    }
     else
     {
-        slave(workInfo, map);
+        slave(workInfo);
     }
 
+    ReportLoad(workInfo, MPI_Wtime() - begin);
+    if (workInfo.solutions)
+    {
+        WriteSolutionIndex(workInfo);
+    }
+    if (workInfo.cache && my_rank == 0)
+    {
+        CacheClose();
+    }
+    CorpusClose(&corpus);
+    MPI_Op_free(&ResultSum);
+    MPI_Type_free(&ResultType);
     MPI_Finalize();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,253 @@
+#include "sudoku_solver.h"
+#include <string.h>
+#include <time.h>
+
+/*
+ * Lockstep solver for many small puzzles, used by the batch mode through SolverCountTasks.
+ *
+ * SOLVER_LANES boards are held in structure-of-arrays form: cand[c] is a vector whose lane g is the candidate mask
+ * of cell c of board g. Naked and hidden singles are applied to every board at once, with the same unit-by-unit pass
+ * and no branch per board, until no board changes. A board whose cells all end up with one candidate has exactly one
+ * solution, a board with a contradiction has none, and only the remaining boards, which need branching, spill to the
+ * scalar SolverCount. Most puzzles of a typical corpus are solved by propagation alone.
+ *
+ * The vectors are GCC vector extensions, so the same kernel is compiled for AVX2 (one instruction per 16 masks of 16 bits) and for
+ * the baseline instruction set of the target, and the AVX2 copy is picked at runtime when the CPU supports it.
+*/
+
+// The candidate masks of one cell of SOLVER_LANES boards
+typedef SudokuMask Lanes __attribute__((vector_size(SOLVER_LANES * sizeof(SudokuMask))));
+
+/*
+ * Function: Nanoseconds
+ * --------------------
+ * Read the monotonic clock
+ *
+ * returns: the time in nanoseconds
+*/
+static long long Nanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/*
+ * Function: PropagateLanes
+ * --------------------
+ * Apply naked and hidden singles to SOLVER_LANES boards until none of them changes. The masks only lose candidates, so the
+ * loop ends. Inlined into one copy per instruction set.
+ *
+ * cand[]: the candidate masks of the SUDOKU_CELLS cells, a given is a mask with one bit
+ * failed: the lanes set to all ones have a contradiction (a cell without candidate, a value given twice in a unit, or a
+ * value with no place left in a unit) and have no solution
+*/
+static inline __attribute__((always_inline)) void PropagateLanes(Lanes cand[], Lanes *failed)
+{
+    const Lanes zero = {0};
+    const Lanes all = zero + SUDOKU_ALL_VALUES;
+    Lanes dead = zero;
+    while (1)
+    {
+        Lanes changed = zero;
+        // Naked singles, the value of a cell with one candidate is removed from the other cells of its units
+        for (int u = 0; u < 3 * SUDOKU_SIZE; u++)
+        {
+            Lanes used = zero;
+            Lanes sum = zero;
+            for (int k = 0; k < SUDOKU_SIZE; k++)
+            {
+                Lanes x = cand[UnitCells[u][k]];
+                Lanes single = x & (Lanes)((x & (x - 1)) == 0);
+                used |= single;
+                sum += single;
+            }
+            // Two singles with the same value in the unit
+            dead |= (Lanes)(used != sum);
+            for (int k = 0; k < SUDOKU_SIZE; k++)
+            {
+                Lanes x = cand[UnitCells[u][k]];
+                Lanes keep = (Lanes)((x & (x - 1)) == 0);
+                Lanes y = x & (~used | keep);
+                changed |= x ^ y;
+                cand[UnitCells[u][k]] = y;
+            }
+        }
+        // Hidden singles, a value with one place left in a unit is filled there
+        for (int u = 0; u < 3 * SUDOKU_SIZE; u++)
+        {
+            Lanes once = zero;
+            Lanes twice = zero;
+            for (int k = 0; k < SUDOKU_SIZE; k++)
+            {
+                Lanes x = cand[UnitCells[u][k]];
+                dead |= (Lanes)(x == 0);
+                twice |= once & x;
+                once |= x;
+            }
+            dead |= (Lanes)(once != all);
+            Lanes exact = once & ~twice;
+            for (int k = 0; k < SUDOKU_SIZE; k++)
+            {
+                Lanes x = cand[UnitCells[u][k]];
+                Lanes hidden = x & exact;
+                Lanes found = (Lanes)(hidden != 0);
+                Lanes y = (hidden & found) | (x & ~found);
+                changed |= x ^ y;
+                cand[UnitCells[u][k]] = y;
+            }
+        }
+        changed &= ~dead;
+        int any = 0;
+        for (int g = 0; g < SOLVER_LANES; g++)
+        {
+            any |= changed[g];
+        }
+        if (!any)
+        {
+            break;
+        }
+    }
+    *failed = dead;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/*
+ * Function: PropagateAVX2
+ * --------------------
+ * PropagateLanes compiled for AVX2
+*/
+__attribute__((target("avx2"))) static void PropagateAVX2(Lanes cand[], Lanes *failed)
+{
+    PropagateLanes(cand, failed);
+}
+#endif
+
+/*
+ * Function: PropagateBase
+ * --------------------
+ * PropagateLanes compiled for the baseline instruction set
+*/
+static void PropagateBase(Lanes cand[], Lanes *failed)
+{
+    PropagateLanes(cand, failed);
+}
+
+/*
+ * Function: SolverCountTasks
+ * --------------------
+ * Count the solutions of many independent puzzles, SOLVER_LANES at a time in lockstep, see above. Gives the same counts
+ * as calling SolverCount on every puzzle, and calls options->onSolution the same way.
+ *
+ * tasks[]: the puzzles, packed by PackMap
+ * n: the number of puzzles
+ * options: the options of SolverCount, used for the puzzles which need branching
+ * stats: the counters of the solver, the cells filled by the lockstep propagation count as propagated, may be NULL
+ * counts[]: filled with the number of solutions of every puzzle
+ * seconds[]: filled with the time spent on every puzzle, a share of the lockstep pass plus its own search, may be NULL
+ * firsts[]: filled with the first solution of every puzzle which has one (SolverCountFirst), for the result cache, may be NULL
+ *
+ * returns: the total number of solutions
+*/
+long long SolverCountTasks(const struct Task tasks[], int n, const struct SolverOptions *options, struct SolverStats *stats,
+                           long long counts[], double seconds[], struct Task firsts[])
+{
+    static void (*propagate)(Lanes cand[], Lanes *failed) = NULL;
+    if (!propagate)
+    {
+        // Every thread picks the same kernel, so a race on the pointer is harmless
+        propagate = PropagateBase;
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            propagate = PropagateAVX2;
+        }
+#endif
+    }
+    Lanes cand[SUDOKU_CELLS];
+    Lanes failed;
+    char map[SUDOKU_CELLS];
+    long long total = 0;
+    for (int first = 0; first < n; first += SOLVER_LANES)
+    {
+        int lanes = n - first < SOLVER_LANES ? n - first : SOLVER_LANES;
+        long long start = Nanoseconds();
+        // The lanes without a puzzle hold an empty board, which propagation leaves alone
+        for (int c = 0; c < SUDOKU_CELLS; c++)
+        {
+            for (int g = 0; g < SOLVER_LANES; g++)
+            {
+                cand[c][g] = SUDOKU_ALL_VALUES;
+            }
+        }
+        for (int g = 0; g < lanes; g++)
+        {
+            UnpackMap(tasks[first + g].grid, map);
+            for (int c = 0; c < SUDOKU_CELLS; c++)
+            {
+                // A value out of range has no candidate bit, the board fails like in BoardInit
+                if (map[c] != 0)
+                {
+                    cand[c][g] = map[c] > 0 && map[c] <= SUDOKU_SIZE ? 1u << (map[c] - 1) : 0;
+                }
+            }
+        }
+        propagate(cand, &failed);
+        double share = (Nanoseconds() - start) / 1e9 / lanes;
+
+        for (int g = 0; g < lanes; g++)
+        {
+            long long begin = Nanoseconds();
+            long long count = 0;
+            if (!failed[g])
+            {
+                // The cells with one candidate become givens, the others are left to the search
+                int filled = 0;
+                int givens = 0;
+                UnpackMap(tasks[first + g].grid, map);
+                for (int c = 0; c < SUDOKU_CELLS; c++)
+                {
+                    unsigned int x = cand[c][g];
+                    givens += map[c] != 0;
+                    if ((x & (x - 1)) == 0)
+                    {
+                        map[c] = __builtin_ctz(x) + 1;
+                        filled++;
+                    }
+                }
+                if (stats)
+                {
+                    stats->propagated += filled - givens;
+                }
+                if (filled == SUDOKU_CELLS)
+                {
+                    count = 1;
+                    if (firsts)
+                    {
+                        PackMap(map, firsts[first + g].grid);
+                    }
+                    if (options->onSolution)
+                    {
+                        options->onSolution(map);
+                    }
+                }
+                else if (firsts)
+                {
+                    count = SolverCountFirst(map, options, stats, &firsts[first + g]);
+                }
+                else
+                {
+                    count = SolverCount(map, options, stats);
+                }
+            }
+            counts[first + g] = count;
+            total += count;
+            if (seconds)
+            {
+                seconds[first + g] = share + (Nanoseconds() - begin) / 1e9;
+            }
+        }
+    }
+    return total;
+}
@@ -0,0 +1,656 @@
+#include "sudoku_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+
+// The hash table starts with CACHE_INITIAL slots and doubles whenever it is half full
+#define CACHE_INITIAL 4096
+
+// A partial transform of SudokuCanonical, whose first rows give the smallest rows found so far
+struct Candidate
+{
+    unsigned char transpose;
+    unsigned int rows;              // Bit r: row r of the puzzle is already a row of the canonical form
+    unsigned char row[SUDOKU_SIZE];
+    unsigned char col[SUDOKU_SIZE];
+    char value[SUDOKU_SIZE + 1];    // The labels given to the values seen so far, 0 for the values not seen yet
+    char next;                      // The label of the next new value
+};
+
+// The state of SudokuCanonical while it builds one row of the canonical form
+struct Canonical
+{
+    char grid[2][SUDOKU_CELLS];   // The puzzle and its transpose
+    char best[SUDOKU_SIZE];       // The smallest row found so far, CHAR_MAX for the cells not compared yet
+    struct Candidate *next;       // The candidates whose rows so far are the smallest
+    int count;                    // The number of candidates in next[]
+    int overflow;                 // 1 once more than CANONICAL_MAX_CANDIDATES candidates tie
+};
+
+// The candidates of the current row and of the next one, allocated at the first call
+static struct Candidate *candidateLists[2];
+
+// The hash table of the cache, capacity is a power of 2
+static struct CacheRecord *table = NULL;
+static long long capacity = 0;
+static long long records = 0;
+static const char *cachePath = NULL;
+static long long hits = 0;
+static long long lookups = 0;
+
+/*
+ * Function: Compare
+ * --------------------
+ * Compare the label of a cell of a candidate row with the smallest row found so far. A smaller label makes the row the
+ * new smallest one: the cells after it are not compared yet and the candidates kept for the other rows are dropped.
+ *
+ * c: the state of SudokuCanonical
+ * j: the column of the cell in the canonical form
+ * label: the label of the cell, 0 for a blank cell
+ *
+ * returns: 1 if the row is still the smallest so far, 0 if it is larger and can be dropped
+*/
+static int Compare(struct Canonical *c, int j, char label)
+{
+    if (label > c->best[j])
+    {
+        return 0;
+    }
+    if (label < c->best[j])
+    {
+        c->best[j] = label;
+        for (int k = j + 1; k < SUDOKU_SIZE; k++)
+        {
+            c->best[k] = CHAR_MAX;
+        }
+        c->count = 0;
+    }
+    return 1;
+}
+
+/*
+ * Function: Keep
+ * --------------------
+ * Add a candidate whose rows are all the smallest so far to the list of the next row
+ *
+ * c: the state of SudokuCanonical
+ * candidate: the candidate, copied
+*/
+static void Keep(struct Canonical *c, const struct Candidate *candidate)
+{
+    if (c->count == CANONICAL_MAX_CANDIDATES)
+    {
+        c->overflow = 1;
+        return;
+    }
+    c->next[c->count++] = *candidate;
+}
+
+/*
+ * Function: PlaceColumns
+ * --------------------
+ * Choose the columns of the canonical form for the first row: every order of the stacks and of the columns within each
+ * stack, keeping the ones which make the first row the smallest
+ *
+ * c: the state of SudokuCanonical
+ * candidate: the transform so far, with its first row and its first j columns chosen
+ * j: the next column of the canonical form
+ * used: bit x: column x of the puzzle is already a column of the canonical form
+*/
+static void PlaceColumns(struct Canonical *c, struct Candidate *candidate, int j, unsigned int used)
+{
+    if (j == SUDOKU_SIZE)
+    {
+        Keep(c, candidate);
+        return;
+    }
+    const char *line = c->grid[candidate->transpose] + candidate->row[0] * SUDOKU_SIZE;
+    for (int x = 0; x < SUDOKU_SIZE && !c->overflow; x++)
+    {
+        // A new stack starts on any unused stack, the other columns stay in the stack of the column before them
+        int allowed = j % SUDOKU_BOX == 0 ? (used >> (x / SUDOKU_BOX * SUDOKU_BOX) & ((1u << SUDOKU_BOX) - 1)) == 0
+                                          : x / SUDOKU_BOX == candidate->col[j - 1] / SUDOKU_BOX && !(used >> x & 1);
+        if (!allowed)
+        {
+            continue;
+        }
+        int v = line[x];
+        int fresh = v != 0 && candidate->value[v] == 0;
+        char label = v == 0 ? 0 : fresh ? candidate->next : candidate->value[v];
+        if (!Compare(c, j, label))
+        {
+            continue;
+        }
+        candidate->col[j] = x;
+        if (fresh)
+        {
+            candidate->value[v] = candidate->next++;
+        }
+        PlaceColumns(c, candidate, j + 1, used | 1u << x);
+        if (fresh)
+        {
+            candidate->value[v] = 0;
+            candidate->next--;
+        }
+    }
+}
+
+/*
+ * Function: PlaceRow
+ * --------------------
+ * Try row r of the puzzle as the next row k of the canonical form of a candidate, and keep the candidate if the row is
+ * the smallest so far
+ *
+ * c: the state of SudokuCanonical
+ * candidate: the candidate, with its first k rows and all its columns chosen
+ * k: the next row of the canonical form
+ * r: the row of the (transposed) puzzle
+*/
+static void PlaceRow(struct Canonical *c, const struct Candidate *candidate, int k, int r)
+{
+    struct Candidate extended = *candidate;
+    const char *line = c->grid[candidate->transpose] + r * SUDOKU_SIZE;
+    for (int j = 0; j < SUDOKU_SIZE; j++)
+    {
+        int v = line[candidate->col[j]];
+        if (v != 0 && extended.value[v] == 0)
+        {
+            extended.value[v] = extended.next++;
+        }
+        if (!Compare(c, j, extended.value[v]))
+        {
+            return;
+        }
+    }
+    extended.row[k] = r;
+    extended.rows |= 1u << r;
+    Keep(c, &extended);
+}
+
+/*
+ * Function: SudokuCanonical
+ * --------------------
+ * Find the canonical form of a puzzle, see above
+ *
+ * map[]: sudoku map array
+ * canonical[]: filled with the canonical form
+ * transform: filled with the transform from the puzzle to canonical[], its values are a permutation of 1 to SUDOKU_SIZE
+ *
+ * returns: 1 if canonical[] is the canonical form, 0 if the puzzle has too many symmetries and canonical[] is a copy
+*/
+int SudokuCanonical(const char map[], char canonical[], struct SudokuTransform *transform)
+{
+    static struct Canonical c;
+    if (!candidateLists[0])
+    {
+        candidateLists[0] = malloc(2 * CANONICAL_MAX_CANDIDATES * sizeof(struct Candidate));
+        candidateLists[1] = candidateLists[0] ? candidateLists[0] + CANONICAL_MAX_CANDIDATES : NULL;
+    }
+    for (int r = 0; r < SUDOKU_SIZE; r++)
+    {
+        for (int x = 0; x < SUDOKU_SIZE; x++)
+        {
+            c.grid[0][r * SUDOKU_SIZE + x] = map[r * SUDOKU_SIZE + x];
+            c.grid[1][r * SUDOKU_SIZE + x] = map[x * SUDOKU_SIZE + r];
+        }
+    }
+    c.overflow = !candidateLists[0];
+    c.count = 0;
+    c.next = candidateLists[0];
+    memset(c.best, CHAR_MAX, sizeof(c.best));
+
+    // The first row, any row of the puzzle or of its transpose with every order of the columns
+    struct Candidate start;
+    memset(&start, 0, sizeof(start));
+    start.next = 1;
+    for (int t = 0; t < 2 && !c.overflow; t++)
+    {
+        for (int r = 0; r < SUDOKU_SIZE && !c.overflow; r++)
+        {
+            start.transpose = t;
+            start.row[0] = r;
+            start.rows = 1u << r;
+            PlaceColumns(&c, &start, 0, 0);
+        }
+    }
+
+    // The other rows, the rest of the band of the row before, or the first row of an unused band
+    for (int k = 1; k < SUDOKU_SIZE && !c.overflow; k++)
+    {
+        const struct Candidate *current = c.next;
+        int n = c.count;
+        c.next = current == candidateLists[0] ? candidateLists[1] : candidateLists[0];
+        c.count = 0;
+        memset(c.best, CHAR_MAX, sizeof(c.best));
+        for (int i = 0; i < n && !c.overflow; i++)
+        {
+            unsigned int rows = current[i].rows;
+            for (int r = 0; r < SUDOKU_SIZE; r++)
+            {
+                int band = rows >> (r / SUDOKU_BOX * SUDOKU_BOX) & ((1u << SUDOKU_BOX) - 1);
+                int allowed = k % SUDOKU_BOX == 0 ? band == 0 : r / SUDOKU_BOX == current[i].row[k - 1] / SUDOKU_BOX && !(rows >> r & 1);
+                if (allowed)
+                {
+                    PlaceRow(&c, &current[i], k, r);
+                }
+            }
+        }
+    }
+
+    if (c.overflow)
+    {
+        transform->transpose = 0;
+        for (int i = 0; i < SUDOKU_SIZE; i++)
+        {
+            transform->row[i] = i;
+            transform->col[i] = i;
+        }
+        for (int v = 0; v <= SUDOKU_SIZE; v++)
+        {
+            transform->value[v] = v;
+        }
+        memcpy(canonical, map, SUDOKU_CELLS);
+        return 0;
+    }
+    // Every candidate left gives the same canonical form, the values which do not appear in the puzzle take the last labels in order
+    struct Candidate best = c.next[0];
+    for (int v = 1; v <= SUDOKU_SIZE; v++)
+    {
+        if (best.value[v] == 0)
+        {
+            best.value[v] = best.next++;
+        }
+    }
+    transform->transpose = best.transpose;
+    memcpy(transform->row, best.row, sizeof(transform->row));
+    memcpy(transform->col, best.col, sizeof(transform->col));
+    memcpy(transform->value, best.value, sizeof(transform->value));
+    TransformApply(transform, map, canonical);
+    return 1;
+}
+
+/*
+ * Function: SourceIndex
+ * --------------------
+ * Get the cell of the puzzle which a transform moves to a cell of the canonical form
+ *
+ * transform: the transform
+ * k, j: the row and the column of the cell in the canonical form
+ *
+ * returns: the index of the cell in the map of the puzzle
+*/
+static int SourceIndex(const struct SudokuTransform *transform, int k, int j)
+{
+    int r = transform->row[k];
+    int x = transform->col[j];
+    return transform->transpose ? x * SUDOKU_SIZE + r : r * SUDOKU_SIZE + x;
+}
+
+/*
+ * Function: TransformApply
+ * --------------------
+ * Move the cells and relabel the values of a grid with a transform, a puzzle becomes its canonical form and its
+ * solutions become the solutions of the canonical form
+ *
+ * transform: the transform
+ * map[]: sudoku map array of the puzzle
+ * canonical[]: filled with the transformed grid
+*/
+void TransformApply(const struct SudokuTransform *transform, const char map[], char canonical[])
+{
+    for (int k = 0; k < SUDOKU_SIZE; k++)
+    {
+        for (int j = 0; j < SUDOKU_SIZE; j++)
+        {
+            canonical[k * SUDOKU_SIZE + j] = transform->value[(int)map[SourceIndex(transform, k, j)]];
+        }
+    }
+}
+
+/*
+ * Function: TransformRevert
+ * --------------------
+ * Undo TransformApply, a solution of the canonical form becomes a solution of the puzzle
+ *
+ * transform: the transform
+ * canonical[]: the transformed grid
+ * map[]: filled with the grid of the puzzle
+*/
+void TransformRevert(const struct SudokuTransform *transform, const char canonical[], char map[])
+{
+    char inverse[SUDOKU_SIZE + 1];
+    for (int v = 0; v <= SUDOKU_SIZE; v++)
+    {
+        inverse[(int)transform->value[v]] = v;
+    }
+    for (int k = 0; k < SUDOKU_SIZE; k++)
+    {
+        for (int j = 0; j < SUDOKU_SIZE; j++)
+        {
+            map[SourceIndex(transform, k, j)] = inverse[(int)canonical[k * SUDOKU_SIZE + j]];
+        }
+    }
+}
+
+/*
+ * Function: Hash
+ * --------------------
+ * FNV-1a hash of a packed canonical form
+ *
+ * canonical: the canonical form
+ *
+ * returns: the hash
+*/
+static unsigned long long Hash(const struct Task *canonical)
+{
+    unsigned long long h = 14695981039346656037ull;
+    for (int i = 0; i < SUDOKU_PACKED_SIZE; i++)
+    {
+        h = (h ^ canonical->grid[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+/*
+ * Function: Find
+ * --------------------
+ * Find the slot of a canonical form in the hash table, linear probing
+ *
+ * canonical: the canonical form
+ *
+ * returns: the slot which holds it, or the empty slot where it would go
+*/
+static struct CacheRecord *Find(const struct Task *canonical)
+{
+    long long i = Hash(canonical) & (capacity - 1);
+    while ((table[i].flags & CACHE_USED) && memcmp(&table[i].canonical, canonical, sizeof(*canonical)) != 0)
+    {
+        i = (i + 1) & (capacity - 1);
+    }
+    return &table[i];
+}
+
+/*
+ * Function: Grow
+ * --------------------
+ * Double the hash table, or allocate it
+ *
+ * returns: 1 if the table is allocated, otherwise, return 0
+*/
+static int Grow(void)
+{
+    struct CacheRecord *old = table;
+    long long oldCapacity = capacity;
+    long long size = capacity ? 2 * capacity : CACHE_INITIAL;
+    struct CacheRecord *grown = calloc(size, sizeof(struct CacheRecord));
+    if (!grown)
+    {
+        return 0;
+    }
+    table = grown;
+    capacity = size;
+    for (long long i = 0; i < oldCapacity; i++)
+    {
+        if (old[i].flags & CACHE_USED)
+        {
+            *Find(&old[i].canonical) = old[i];
+        }
+    }
+    free(old);
+    return 1;
+}
+
+/*
+ * Function: Store
+ * --------------------
+ * Add what is known about a canonical form to the cache. An exact count replaces a lower bound, a larger lower bound
+ * replaces a smaller one, and a solution is kept once there is one.
+ *
+ * record: the canonical form, its count, its flags and its solution in canonical form
+*/
+static void Store(const struct CacheRecord *record)
+{
+    if (2 * (records + 1) > capacity && !Grow())
+    {
+        return;
+    }
+    struct CacheRecord *slot = Find(&record->canonical);
+    if (!(slot->flags & CACHE_USED))
+    {
+        *slot = *record;
+        slot->flags |= CACHE_USED;
+        records++;
+        return;
+    }
+    if ((record->flags & CACHE_EXACT) || (!(slot->flags & CACHE_EXACT) && record->count > slot->count))
+    {
+        slot->count = record->count;
+        slot->flags |= record->flags & CACHE_EXACT;
+    }
+    if ((record->flags & CACHE_SOLVED) && !(slot->flags & CACHE_SOLVED))
+    {
+        slot->solution = record->solution;
+        slot->flags |= CACHE_SOLVED;
+    }
+}
+
+/*
+ * Function: CacheOpen
+ * --------------------
+ * Create the cache, and load the records of its file when the file exists
+ *
+ * path: the file of the cache, written back by CacheClose, NULL to keep the cache in memory only
+ *
+ * returns: 1 if the cache is ready, 0 if the file can not be read or is not a cache file
+*/
+int CacheOpen(const char *path)
+{
+    cachePath = path;
+    if (!Grow())
+    {
+        return 0;
+    }
+    FILE *in = path ? fopen(path, "rb") : NULL;
+    if (!in)
+    {
+        return !path || errno == ENOENT;
+    }
+    struct CacheHeader header;
+    struct CacheRecord record;
+    int ok = fread(&header, sizeof(header), 1, in) == 1 && memcmp(header.magic, CACHE_MAGIC, 4) == 0 && header.version == CACHE_VERSION &&
+             header.headerSize == sizeof(header) && header.recordSize == sizeof(record);
+    for (uint64_t i = 0; ok && i < header.count; i++)
+    {
+        ok = fread(&record, sizeof(record), 1, in) == 1;
+        if (ok)
+        {
+            Store(&record);
+        }
+    }
+    fclose(in);
+    if (!ok)
+    {
+        fprintf(stderr, "%s is not a result cache of this version or grid size, or it is truncated!\n", path);
+    }
+    return ok;
+}
+
+/*
+ * Function: CacheMakeKey
+ * --------------------
+ * Find the key of a puzzle in the cache
+ *
+ * map[]: sudoku map array
+ * key: filled with the canonical form of the puzzle and the transform to it
+*/
+void CacheMakeKey(const char map[], struct CacheKey *key)
+{
+    char canonical[SUDOKU_CELLS];
+    SudokuCanonical(map, canonical, &key->transform);
+    PackMap(canonical, key->canonical.grid);
+}
+
+/*
+ * Function: CacheLookup
+ * --------------------
+ * Look a puzzle up in the cache
+ *
+ * key: the key of the puzzle, from CacheMakeKey
+ * limit: the number of solutions the search would stop at (--find), 0 for all of them
+ * count: set to the number of solutions, at most limit when there is one, as the search would find
+ * solution[]: filled with a solution of the puzzle when it has one, NULL if it is not needed. A record without a solution
+ *             does not answer a lookup which needs one.
+ *
+ * returns: 1 if the cache answers the lookup, otherwise, return 0
+*/
+int CacheLookup(const struct CacheKey *key, long long limit, long long *count, char solution[])
+{
+    lookups++;
+    const struct CacheRecord *record = Find(&key->canonical);
+    if (!(record->flags & CACHE_USED) || !((record->flags & CACHE_EXACT) || (limit > 0 && record->count >= limit)) ||
+        (solution && record->count > 0 && !(record->flags & CACHE_SOLVED)))
+    {
+        return 0;
+    }
+    // A search with a limit stops at it, even when more solutions are known
+    *count = limit > 0 && record->count > limit ? limit : record->count;
+    if (solution && record->count > 0)
+    {
+        char canonical[SUDOKU_CELLS];
+        UnpackMap(record->solution.grid, canonical);
+        TransformRevert(&key->transform, canonical, solution);
+    }
+    hits++;
+    return 1;
+}
+
+/*
+ * Function: CacheInsert
+ * --------------------
+ * Add the result of a puzzle to the cache
+ *
+ * key: the key of the puzzle, from CacheMakeKey
+ * limit: the number of solutions the search stopped at (--find), 0 if it counted all of them
+ * count: the number of solutions found
+ * solution: a solution of the puzzle, packed by PackMap, NULL if there is none
+*/
+void CacheInsert(const struct CacheKey *key, long long limit, long long count, const struct Task *solution)
+{
+    struct CacheRecord record;
+    memset(&record, 0, sizeof(record));
+    record.canonical = key->canonical;
+    record.count = count;
+    // Fewer solutions than the limit means the search ran to the end
+    record.flags = limit == 0 || count < limit ? CACHE_EXACT : 0;
+    if (solution && count > 0)
+    {
+        char map[SUDOKU_CELLS];
+        char canonical[SUDOKU_CELLS];
+        UnpackMap(solution->grid, map);
+        TransformApply(&key->transform, map, canonical);
+        PackMap(canonical, record.solution.grid);
+        record.flags |= CACHE_SOLVED;
+    }
+    Store(&record);
+}
+
+/*
+ * Function: CacheSolve
+ * --------------------
+ * Count the solutions of a puzzle through the cache: look it up, and on a miss count them with SolverCountFirst and add
+ * the result to the cache
+ *
+ * map[]: sudoku map array
+ * options: the options of SolverCount
+ * stats: the counters of the search are added to it, may be NULL
+ *
+ * returns: the number of solutions to the sudoku puzzle
+*/
+long long CacheSolve(char map[], const struct SolverOptions *options, struct SolverStats *stats)
+{
+    struct CacheKey key;
+    struct Task solution;
+    long long count;
+    CacheMakeKey(map, &key);
+    if (CacheLookup(&key, options->limit, &count, NULL))
+    {
+        return count;
+    }
+    count = SolverCountFirst(map, options, stats, &solution);
+    // A cancelled search has no count worth keeping
+    if (!SolverCancelled())
+    {
+        CacheInsert(&key, options->limit, count, &solution);
+    }
+    return count;
+}
+
+/*
+ * Function: CacheCounters
+ * --------------------
+ * Get the use of the cache so far
+ *
+ * hitCount: set to the number of lookups answered by the cache
+ * lookupCount: set to the number of lookups
+ * recordCount: set to the number of puzzles in the cache, up to their symmetries
+*/
+void CacheCounters(long long *hitCount, long long *lookupCount, long long *recordCount)
+{
+    *hitCount = hits;
+    *lookupCount = lookups;
+    *recordCount = records;
+}
+
+/*
+ * Function: CacheClose
+ * --------------------
+ * Write the cache to its file, if it has one, and free it
+ *
+ * returns: 1 if the file is written or there is none, otherwise, return 0
+*/
+int CacheClose(void)
+{
+    int ok = 1;
+    if (cachePath && table)
+    {
+        // The records go to a new file which then replaces the old one, so a failed write leaves the old cache
+        char temporary[4096];
+        snprintf(temporary, sizeof(temporary), "%s.tmp", cachePath);
+        FILE *out = fopen(temporary, "wb");
+        struct CacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, CACHE_MAGIC, 4);
+        header.version = CACHE_VERSION;
+        header.headerSize = sizeof(header);
+        header.recordSize = sizeof(struct CacheRecord);
+        header.count = records;
+        ok = out && fwrite(&header, sizeof(header), 1, out) == 1;
+        for (long long i = 0; ok && i < capacity; i++)
+        {
+            if (table[i].flags & CACHE_USED)
+            {
+                ok = fwrite(&table[i], sizeof(table[i]), 1, out) == 1;
+            }
+        }
+        if (out && fclose(out) != 0)
+        {
+            ok = 0;
+        }
+        if (ok && rename(temporary, cachePath) != 0)
+        {
+            ok = 0;
+        }
+        if (!ok)
+        {
+            fprintf(stderr, "Failed to write the result cache %s!\n", cachePath);
+            remove(temporary);
+        }
+    }
+    free(table);
+    table = NULL;
+    capacity = 0;
+    records = 0;
+    return ok;
+}
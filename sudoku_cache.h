@@ -0,0 +1,92 @@
+#ifndef SUDOKU_CACHE_H
+#define SUDOKU_CACHE_H
+
+#include <stdint.h>
+#include "sudoku_solver.h"
+
+/*
+ * Canonical forms of the puzzles and the cache of their results, --cache[=FILE] of sudoku_serial and the MPI program.
+ *
+ * Transposing the grid, permuting the bands, the stacks, the rows within a band and the columns within a stack, and
+ * relabeling the values turn a puzzle into one with the same number of solutions, and its solutions into the solutions
+ * of the other. The canonical form of a puzzle is the smallest of all these images, compared cell by cell in row-major
+ * order with the blank cells first and the values relabeled in the order they first appear, so all the puzzles which
+ * are the same up to these symmetries have the same canonical form. SudokuCanonical builds it row by row, keeping only
+ * the partial transforms whose rows so far are the smallest. A grid so symmetric that more than CANONICAL_MAX_CANDIDATES
+ * partial transforms tie, like an almost empty one, is kept as it is: it is still a valid key, it only misses the cache
+ * for its other images.
+ *
+ * The cache maps the canonical form of a puzzle to its number of solutions and to one of its solutions, kept in the
+ * cells and values of the canonical form and mapped back to the puzzle on a hit. A count found with --find=N answers the
+ * later lookups it covers: any limit when the search ran to the end (fewer than N solutions), otherwise the limits up
+ * to N. The cache is an open addressing hash table in memory, loaded from FILE by CacheOpen and written back by
+ * CacheClose: a struct CacheHeader in the byte order of the machine followed by the records. Only one thread uses it,
+ * in the MPI program the master process, which looks the puzzles up before it hands them out.
+*/
+
+// SudokuCanonical keeps the puzzle as it is when more partial transforms than this tie
+#define CANONICAL_MAX_CANDIDATES (1 << 14)
+
+// First bytes of a cache file, and the version of its layout
+#define CACHE_MAGIC "SDKR"
+#define CACHE_VERSION 1
+
+// A symmetry of the grid, from a puzzle to its canonical form
+struct SudokuTransform
+{
+    unsigned char transpose;        // 1: the rows of the canonical form are taken from the columns of the puzzle
+    unsigned char row[SUDOKU_SIZE]; // The row of the (transposed) puzzle of every row of the canonical form
+    unsigned char col[SUDOKU_SIZE]; // The column of the (transposed) puzzle of every column of the canonical form
+    char value[SUDOKU_SIZE + 1];    // The value in the canonical form of every value of the puzzle, value[0] = 0
+};
+
+// The key of a puzzle in the cache
+struct CacheKey
+{
+    struct Task canonical;            // The canonical form, packed by PackMap
+    struct SudokuTransform transform; // From the puzzle to its canonical form
+};
+
+struct CacheHeader
+{
+    char magic[4];       // CACHE_MAGIC
+    uint32_t version;    // CACHE_VERSION
+    uint32_t headerSize; // sizeof(struct CacheHeader), the offset of the first record
+    uint32_t recordSize; // sizeof(struct CacheRecord)
+    uint64_t count;      // The number of records
+};
+
+// Flags of a cache record
+#define CACHE_USED 1   // The slot of the hash table holds a record
+#define CACHE_EXACT 2  // count is the number of solutions, not a lower bound found with --find
+#define CACHE_SOLVED 4 // solution holds a solution
+
+struct CacheRecord
+{
+    struct Task canonical; // The canonical form, packed by PackMap
+    struct Task solution;  // A solution, in the cells and values of the canonical form
+    unsigned char flags;   // CACHE_USED, CACHE_EXACT, CACHE_SOLVED
+    long long count;       // The number of solutions, at least count without CACHE_EXACT
+};
+
+int SudokuCanonical(const char map[], char canonical[], struct SudokuTransform *transform);
+
+void TransformApply(const struct SudokuTransform *transform, const char map[], char canonical[]);
+
+void TransformRevert(const struct SudokuTransform *transform, const char canonical[], char map[]);
+
+int CacheOpen(const char *path);
+
+void CacheMakeKey(const char map[], struct CacheKey *key);
+
+int CacheLookup(const struct CacheKey *key, long long limit, long long *count, char solution[]);
+
+void CacheInsert(const struct CacheKey *key, long long limit, long long count, const struct Task *solution);
+
+long long CacheSolve(char map[], const struct SolverOptions *options, struct SolverStats *stats);
+
+void CacheCounters(long long *hitCount, long long *lookupCount, long long *recordCount);
+
+int CacheClose(void);
+
+#endif
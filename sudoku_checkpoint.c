@@ -0,0 +1,98 @@
+#include "sudoku_checkpoint.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Function: CheckpointInit
+ * --------------------
+ * Fill the header of the checkpoints of a run, without work done yet
+ *
+ * header: the header to fill
+ * map[]: sudoku map array, the puzzle of the run
+ * symmetry: 1 if the tasks are split from the representatives of --symmetry
+ * ranks: the number of processes
+*/
+void CheckpointInit(struct CheckpointHeader *header, const char map[], int symmetry, int ranks)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, CHECKPOINT_MAGIC, 4);
+    header->version = CHECKPOINT_VERSION;
+    header->headerSize = sizeof(*header);
+    header->recordSize = sizeof(struct Task);
+    header->symmetry = symmetry;
+    header->ranks = ranks;
+    PackMap(map, header->puzzle.grid);
+}
+
+/*
+ * Function: CheckpointWrite
+ * --------------------
+ * Write a checkpoint, to a new file which then replaces FILE
+ *
+ * path: the checkpoint file
+ * header: the header from CheckpointInit with the solutions of the work done, its count is set to n
+ * tasks[]: the work left
+ * n: the number of tasks
+ *
+ * returns: 1 if the checkpoint is written, otherwise, return 0 and the last checkpoint is left as it was
+*/
+int CheckpointWrite(const char *path, struct CheckpointHeader *header, const struct Task tasks[], long long n)
+{
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    header->count = n;
+    FILE *out = fopen(temporary, "wb");
+    int ok = out && fwrite(header, sizeof(*header), 1, out) == 1 && (n == 0 || fwrite(tasks, sizeof(struct Task), n, out) == (size_t)n);
+    if (out && fclose(out) != 0)
+    {
+        ok = 0;
+    }
+    if (ok && rename(temporary, path) != 0)
+    {
+        ok = 0;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "Failed to write the checkpoint %s!\n", path);
+        remove(temporary);
+    }
+    return ok;
+}
+
+/*
+ * Function: CheckpointRead
+ * --------------------
+ * Read a checkpoint
+ *
+ * path: the checkpoint file
+ * header: filled with its header
+ *
+ * returns: the tasks left, header->count of them, allocated with malloc and freed by the caller. NULL if the file can not
+ * be read, is not a checkpoint of this version and grid size, or is truncated.
+*/
+struct Task *CheckpointRead(const char *path, struct CheckpointHeader *header)
+{
+    FILE *in = fopen(path, "rb");
+    if (!in)
+    {
+        fprintf(stderr, "Can not open the checkpoint %s!\n", path);
+        return NULL;
+    }
+    struct Task *tasks = NULL;
+    int ok = fread(header, sizeof(*header), 1, in) == 1 && memcmp(header->magic, CHECKPOINT_MAGIC, 4) == 0 &&
+             header->version == CHECKPOINT_VERSION && header->headerSize == sizeof(*header) && header->recordSize == sizeof(struct Task);
+    if (ok)
+    {
+        tasks = malloc((header->count > 0 ? header->count : 1) * sizeof(struct Task));
+        ok = tasks && fread(tasks, sizeof(struct Task), header->count, in) == header->count;
+    }
+    fclose(in);
+    if (!ok)
+    {
+        fprintf(stderr, "%s is not a checkpoint of this version or grid size, or it is truncated!\n", path);
+        free(tasks);
+        return NULL;
+    }
+    return tasks;
+}
@@ -0,0 +1,41 @@
+#ifndef SUDOKU_CHECKPOINT_H
+#define SUDOKU_CHECKPOINT_H
+
+#include <stdint.h>
+#include "sudoku_solver.h"
+
+/*
+ * Checkpoints of a long count of the MPI program, --checkpoint=FILE and --restart.
+ *
+ * A checkpoint holds the count at a consistent point of the run: the solutions found by the work already done, and the
+ * work left as tasks, the tasks not handed out yet, the tasks of the chunks not started yet, and the search stack of every
+ * running search described by SolverFrontier. Counting the solutions of the tasks and adding the solutions of the
+ * checkpoint gives the count of the puzzle, with any number of processes. The file is a struct CheckpointHeader in the
+ * byte order of the machine followed by the task records, like a puzzle corpus (sudoku_io.h), and it is replaced as a
+ * whole by every checkpoint, so a run killed while writing it still leaves the last one.
+*/
+
+// First bytes of a checkpoint file, and the version of its layout
+#define CHECKPOINT_MAGIC "SDKP"
+#define CHECKPOINT_VERSION 1
+
+struct CheckpointHeader
+{
+    char magic[4];       // CHECKPOINT_MAGIC
+    uint32_t version;    // CHECKPOINT_VERSION
+    uint32_t headerSize; // sizeof(struct CheckpointHeader), the offset of the first record
+    uint32_t recordSize; // sizeof(struct Task)
+    uint64_t count;      // The number of tasks left
+    int64_t solutions;   // The number of solutions of the work done
+    uint32_t symmetry;   // 1: the tasks are split from the representatives of --symmetry, see SolverRepresentatives
+    uint32_t ranks;      // The number of processes of the run which wrote it
+    struct Task puzzle;  // The puzzle, packed by PackMap, a restart must count the same one
+};
+
+void CheckpointInit(struct CheckpointHeader *header, const char map[], int symmetry, int ranks);
+
+int CheckpointWrite(const char *path, struct CheckpointHeader *header, const struct Task tasks[], long long n);
+
+struct Task *CheckpointRead(const char *path, struct CheckpointHeader *header);
+
+#endif
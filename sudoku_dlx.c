@@ -0,0 +1,277 @@
+#include "sudoku_solver.h"
+
+#include <stdlib.h>
+
+/*
+ * Dancing Links (Algorithm X) backend of SolverCount.
+ *
+ * A sudoku is an exact cover problem: every candidate (cell, value) is a row of the matrix, and it covers 4 of the
+ * 4 * SUDOKU_CELLS columns, for the 9x9 grid:
+ * column 0-80:    the cell is filled
+ * column 81-161:  the value is used in its row
+ * column 162-242: the value is used in its column
+ * column 243-323: the value is used in its box
+ * A solution is a set of 81 rows which covers every column exactly once. The matrix is stored as circular doubly linked
+ * lists, so covering and uncovering a column on the way down and up of the search are O(1) per link.
+*/
+
+#define DLX_COLUMNS (4 * SUDOKU_CELLS)
+#define DLX_ROWS (SUDOKU_CELLS * SUDOKU_SIZE)
+// Node 0 is the root, nodes 1..DLX_COLUMNS are the column headers, followed by 4 nodes for each row
+#define DLX_NODES (1 + DLX_COLUMNS + 4 * DLX_ROWS)
+
+// Node pool of the matrix, allocated once per solve and reused by every solution
+struct Dlx
+{
+    int left[DLX_NODES];
+    int right[DLX_NODES];
+    int up[DLX_NODES];
+    int down[DLX_NODES];
+    int column[DLX_NODES];           // Column header of each node
+    int row[DLX_NODES];              // Matrix row of each node, row = index * SUDOKU_SIZE + value - 1
+    int size[1 + DLX_COLUMNS];       // Number of nodes left in each column
+};
+
+/*
+ * Function: DlxCover
+ * --------------------
+ * Remove column c from the header list, and every row which has a node in column c from the other columns
+ *
+ * dlx: the matrix
+ * c: column header node
+*/
+static void DlxCover(struct Dlx *dlx, int c)
+{
+    dlx->right[dlx->left[c]] = dlx->right[c];
+    dlx->left[dlx->right[c]] = dlx->left[c];
+    for (int i = dlx->down[c]; i != c; i = dlx->down[i])
+    {
+        for (int j = dlx->right[i]; j != i; j = dlx->right[j])
+        {
+            dlx->down[dlx->up[j]] = dlx->down[j];
+            dlx->up[dlx->down[j]] = dlx->up[j];
+            dlx->size[dlx->column[j]]--;
+        }
+    }
+}
+
+/*
+ * Function: DlxUncover
+ * --------------------
+ * Undo DlxCover in the reverse order
+ *
+ * dlx: the matrix
+ * c: column header node
+*/
+static void DlxUncover(struct Dlx *dlx, int c)
+{
+    for (int i = dlx->up[c]; i != c; i = dlx->up[i])
+    {
+        for (int j = dlx->left[i]; j != i; j = dlx->left[j])
+        {
+            dlx->size[dlx->column[j]]++;
+            dlx->down[dlx->up[j]] = j;
+            dlx->up[dlx->down[j]] = j;
+        }
+    }
+    dlx->right[dlx->left[c]] = c;
+    dlx->left[dlx->right[c]] = c;
+}
+
+/*
+ * Function: DlxBuild
+ * --------------------
+ * Link the DLX_ROWS x DLX_COLUMNS exact cover matrix of an empty sudoku map
+ *
+ * dlx: the matrix
+*/
+static void DlxBuild(struct Dlx *dlx)
+{
+    for (int c = 0; c <= DLX_COLUMNS; c++)
+    {
+        dlx->left[c] = c == 0 ? DLX_COLUMNS : c - 1;
+        dlx->right[c] = c == DLX_COLUMNS ? 0 : c + 1;
+        dlx->up[c] = c;
+        dlx->down[c] = c;
+        dlx->column[c] = c;
+        dlx->size[c] = 0;
+    }
+    int node = DLX_COLUMNS + 1;
+    for (int index = 0; index < SUDOKU_CELLS; index++)
+    {
+        for (int v = 0; v < SUDOKU_SIZE; v++)
+        {
+            int columns[4] = {
+                1 + index,
+                1 + SUDOKU_CELLS + CellRow[index] * SUDOKU_SIZE + v,
+                1 + 2 * SUDOKU_CELLS + CellCol[index] * SUDOKU_SIZE + v,
+                1 + 3 * SUDOKU_CELLS + CellBox[index] * SUDOKU_SIZE + v};
+            for (int k = 0; k < 4; k++)
+            {
+                int c = columns[k];
+                // Append the node at the bottom of its column and at the end of its row
+                dlx->column[node] = c;
+                dlx->row[node] = index * SUDOKU_SIZE + v;
+                dlx->up[node] = dlx->up[c];
+                dlx->down[node] = c;
+                dlx->down[dlx->up[c]] = node;
+                dlx->up[c] = node;
+                dlx->size[c]++;
+                dlx->left[node] = k == 0 ? node + 3 : node - 1;
+                dlx->right[node] = k == 3 ? node - 3 : node + 1;
+                node++;
+            }
+        }
+    }
+}
+
+/*
+ * Function: DlxCount
+ * --------------------
+ * Count the solutions of the sudoku puzzle with Algorithm X over the exact cover matrix. The values already filled in the
+ * map are taken as chosen rows before the search, then the search always branches on the column with the fewest rows
+ * left. The search is iterative, rows[level] is the row tried for the column chosen at each level.
+ *
+ * map[]: sudoku map array, restored to the input puzzle when the function returns
+ * options: options->onSolution is called with the filled map for every solution found, options->onPoll every SOLVER_POLL_INTERVAL rows tried,
+ * the search stops after options->limit solutions or when SolverCancel is called
+ * stats: stats->nodes is increased by the number of rows tried, backtracks and checks as in SolverCount, may be NULL
+ *
+ * returns: the number of solutions to the sudoku puzzle, 0 if the input is invalid
+*/
+long long DlxCount(char map[], const struct SolverOptions *options, struct SolverStats *stats)
+{
+    struct Board board;
+    long long count = 0;
+    // The givens must not share a column of the matrix
+    if (!BoardInit(&board, map))
+    {
+        return count;
+    }
+    struct Dlx *dlx = malloc(sizeof(struct Dlx));
+    if (!dlx)
+    {
+        return count;
+    }
+    DlxBuild(dlx);
+
+    // Choose the rows of the given values, the first node of row (index, value) is DLX_COLUMNS + 1 + 4 * row
+    for (int index = 0; index < SUDOKU_CELLS; index++)
+    {
+        if (map[index] != 0)
+        {
+            int r = DLX_COLUMNS + 1 + 4 * (index * SUDOKU_SIZE + map[index] - 1);
+            DlxCover(dlx, dlx->column[r]);
+            for (int j = dlx->right[r]; j != r; j = dlx->right[j])
+            {
+                DlxCover(dlx, dlx->column[j]);
+            }
+        }
+    }
+
+    int cols[SUDOKU_CELLS + 1];
+    int rows[SUDOKU_CELLS + 1];
+    int level = 0;
+    long long nodes = 0;
+    long long backtracks = 0;
+    long long checks = 0;
+    // 1: the search moved forward to a new level, 0: it came back to level from a deeper one
+    int advance = 1;
+    while (level >= 0)
+    {
+        if (advance)
+        {
+            // When every column is covered, a valid solution for the sudoku puzzle is found successfully
+            if (dlx->right[0] == 0)
+            {
+                count++;
+                if (options->onSolution)
+                {
+                    options->onSolution(map);
+                }
+                if ((options->limit > 0 && count >= options->limit) || SolverCancelled())
+                {
+                    break;
+                }
+                level--;
+                advance = 0;
+                continue;
+            }
+            // Branch on the column with the fewest rows, a column without any row means the last row was wrong
+            int c = dlx->right[0];
+            for (int j = dlx->right[c]; j != 0; j = dlx->right[j])
+            {
+                if (dlx->size[j] < dlx->size[c])
+                {
+                    c = j;
+                }
+                checks++;
+            }
+            if (dlx->size[c] == 0)
+            {
+                backtracks++;
+                level--;
+                advance = 0;
+                continue;
+            }
+            DlxCover(dlx, c);
+            cols[level] = c;
+            rows[level] = dlx->down[c];
+        }
+        else
+        {
+            // Release the row tried at this level and move to the next row of the column
+            int r = rows[level];
+            for (int j = dlx->left[r]; j != r; j = dlx->left[j])
+            {
+                DlxUncover(dlx, dlx->column[j]);
+            }
+            map[dlx->row[r] / SUDOKU_SIZE] = 0;
+            rows[level] = dlx->down[r];
+        }
+        int r = rows[level];
+        // Every row of the column has been tried
+        if (r == cols[level])
+        {
+            DlxUncover(dlx, cols[level]);
+            backtracks++;
+            level--;
+            advance = 0;
+            continue;
+        }
+        map[dlx->row[r] / SUDOKU_SIZE] = dlx->row[r] % SUDOKU_SIZE + 1;
+        for (int j = dlx->right[r]; j != r; j = dlx->right[j])
+        {
+            DlxCover(dlx, dlx->column[j]);
+        }
+        nodes++;
+        level++;
+        advance = 1;
+        if ((nodes & (SOLVER_POLL_INTERVAL - 1)) == 0)
+        {
+            if (options->onPoll)
+            {
+                options->onPoll();
+            }
+            if (SolverCancelled())
+            {
+                break;
+            }
+        }
+    }
+
+    // A search which stopped early leaves the rows of levels 0..level-1 in the map
+    for (int l = 0; l < level; l++)
+    {
+        map[dlx->row[rows[l]] / SUDOKU_SIZE] = 0;
+    }
+
+    free(dlx);
+    if (stats)
+    {
+        stats->nodes += nodes;
+        stats->backtracks += backtracks;
+        stats->checks += checks;
+    }
+    return count;
+}
@@ -0,0 +1,501 @@
+#include "sudoku_io.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * Function: OpenPuzzles
+ * --------------------
+ * Open a puzzle file for ReadPuzzle
+ *
+ * path: the file name, "-" for stdin
+ *
+ * returns: the stream, NULL if the file can not be opened
+*/
+FILE *OpenPuzzles(const char *path)
+{
+    if (strcmp(path, "-") == 0)
+    {
+        return stdin;
+    }
+    return fopen(path, "r");
+}
+
+/*
+ * Function: ClosePuzzles
+ * --------------------
+ * Close a stream returned by OpenPuzzles, stdin is left open
+ *
+ * in: the stream
+*/
+void ClosePuzzles(FILE *in)
+{
+    if (in && in != stdin)
+    {
+        fclose(in);
+    }
+}
+
+/*
+ * Function: ParseGrid
+ * --------------------
+ * Read a puzzle in the SUDOKU_CELLS characters format
+ *
+ * line: the line without its end of line
+ * len: the length of the line
+ * map[]: sudoku map array
+ *
+ * returns: 1 if the line is a puzzle in this format, otherwise, return 0
+*/
+static int ParseGrid(const char *line, int len, char map[])
+{
+    if (len != SUDOKU_CELLS)
+    {
+        return 0;
+    }
+    for (int i = 0; i < SUDOKU_CELLS; i++)
+    {
+        // The values above 9 of the larger grids are letters, 'A' or 'a' for 10
+        int c = toupper((unsigned char)line[i]);
+        int value = c >= '1' && c <= '9' ? c - '0' : c >= 'A' && c <= 'Z' ? c - 'A' + 10 : -1;
+        if (value >= 1 && value <= SUDOKU_SIZE)
+        {
+            map[i] = value;
+        }
+        else if (c == '0' || c == '.')
+        {
+            map[i] = 0;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Function: ParseTriples
+ * --------------------
+ * Read a puzzle given as "x y value" triples, the same rules as ParseArgv
+ *
+ * line: the line
+ * map[]: sudoku map array
+ *
+ * returns: 1 if the line is a puzzle in this format, otherwise, return 0
+*/
+static int ParseTriples(const char *line, char map[])
+{
+    memset(map, 0, SUDOKU_CELLS);
+    const char *p = line;
+    while (1)
+    {
+        long v[3];
+        for (int k = 0; k < 3; k++)
+        {
+            char *end;
+            v[k] = strtol(p, &end, 10);
+            if (end == p)
+            {
+                // The line may only end between two triples
+                while (isspace((unsigned char)*p))
+                {
+                    p++;
+                }
+                return k == 0 && *p == '\0';
+            }
+            p = end;
+        }
+        if (v[0] < 1 || v[0] > SUDOKU_SIZE || v[1] < 1 || v[1] > SUDOKU_SIZE || v[2] < 1 || v[2] > SUDOKU_SIZE)
+        {
+            return 0;
+        }
+        map[(v[0] - 1) * SUDOKU_SIZE + v[1] - 1] = (char)v[2];
+    }
+}
+
+/*
+ * Function: ParsePuzzle
+ * --------------------
+ * Read a puzzle line in either format of a puzzle file
+ *
+ * line: the line without its end of line
+ * len: the length of the line
+ * map[]: sudoku map array, filled with the puzzle
+ *
+ * returns: 1 if the line is a puzzle, otherwise, return 0
+*/
+int ParsePuzzle(const char *line, int len, char map[])
+{
+    return ParseGrid(line, len, map) || ParseTriples(line, map);
+}
+
+/*
+ * Function: ReadPuzzleLine
+ * --------------------
+ * Read the next line of a puzzle file which is not empty or a comment, without its end of line and trailing spaces
+ *
+ * in: the stream
+ * line[]: a buffer of PUZZLE_LINE_MAX characters, filled with the line
+ * len: set to the length of the line
+ *
+ * returns: PUZZLE_OK, PUZZLE_INVALID if the line is too long to be a puzzle, or PUZZLE_END
+*/
+int ReadPuzzleLine(FILE *in, char line[], int *len)
+{
+    while (fgets(line, PUZZLE_LINE_MAX, in))
+    {
+        int n = strlen(line);
+        int truncated = n == PUZZLE_LINE_MAX - 1 && line[n - 1] != '\n';
+        if (truncated)
+        {
+            // Skip the rest of a line which is too long to be a puzzle
+            int c;
+            while ((c = fgetc(in)) != EOF && c != '\n')
+            {
+            }
+            return PUZZLE_INVALID;
+        }
+        while (n > 0 && isspace((unsigned char)line[n - 1]))
+        {
+            line[--n] = '\0';
+        }
+        if (n > 0 && line[0] != '#')
+        {
+            *len = n;
+            return PUZZLE_OK;
+        }
+    }
+    return PUZZLE_END;
+}
+
+/*
+ * Function: ReadPuzzle
+ * --------------------
+ * Read the next puzzle of a puzzle file, skipping the empty lines and the comments
+ *
+ * in: the stream returned by OpenPuzzles
+ * map[]: sudoku map array, filled with the puzzle
+ *
+ * returns: PUZZLE_OK, PUZZLE_INVALID if the next line is not a puzzle, or PUZZLE_END
+*/
+int ReadPuzzle(FILE *in, char map[])
+{
+    char line[PUZZLE_LINE_MAX];
+    int len;
+    int status = ReadPuzzleLine(in, line, &len);
+    if (status == PUZZLE_OK && !ParsePuzzle(line, len, map))
+    {
+        return PUZZLE_INVALID;
+    }
+    return status;
+}
+
+/*
+ * Function: PrintPuzzle
+ * --------------------
+ * Write a sudoku map as one line of SUDOKU_CELLS characters, the format read by ParsePuzzle
+ *
+ * out: the output stream
+ * map[]: sudoku map array
+*/
+void PrintPuzzle(FILE *out, const char map[])
+{
+    char line[SUDOKU_CELLS + 2];
+    for (int i = 0; i < SUDOKU_CELLS; i++)
+    {
+        line[i] = map[i] == 0 ? '.' : map[i] <= 9 ? '0' + map[i] : 'A' + map[i] - 10;
+    }
+    line[SUDOKU_CELLS] = '\n';
+    line[SUDOKU_CELLS + 1] = '\0';
+    fputs(line, out);
+}
+
+/*
+ * Function: PrintPuzzleResult
+ * --------------------
+ * Write the output line of a puzzle in batch mode
+ *
+ * out: the output stream
+ * index: the index of the puzzle, from 1
+ * count: the number of solutions, -1 if the line was not a puzzle
+ * seconds: the time spent on the puzzle
+*/
+void PrintPuzzleResult(FILE *out, long long index, long long count, double seconds)
+{
+    if (count < 0)
+    {
+        fprintf(out, "%lld invalid\n", index);
+    }
+    else
+    {
+        fprintf(out, "%lld %lld %.3f\n", index, count, seconds * 1000);
+    }
+}
+
+/*
+ * Function: PrintFindResult
+ * --------------------
+ * Write what a search stopped by --find tells about the puzzle, nothing when every solution was counted
+ *
+ * out: the output stream
+ * count: the number of solutions found
+ * limit: SolverOptions.limit of the search
+*/
+void PrintFindResult(FILE *out, long long count, long long limit)
+{
+    if (limit <= 0)
+    {
+        return;
+    }
+    if (count == 0)
+    {
+        fprintf(out, "The sudoku has no solution.\n");
+    }
+    else if (limit == 1)
+    {
+        fprintf(out, "The sudoku has a solution, the search stopped at the first one.\n");
+    }
+    else if (limit == 2)
+    {
+        fprintf(out, count == 1 ? "The solution is unique.\n" : "The solution is not unique.\n");
+    }
+    else if (count >= limit)
+    {
+        fprintf(out, "The sudoku has at least %lld solutions, the search stopped there.\n", limit);
+    }
+    else
+    {
+        fprintf(out, "The sudoku has exactly %lld solutions.\n", count);
+    }
+}
+
+/*
+ * Function: WallSeconds
+ * --------------------
+ * Read the monotonic clock, for the time of the puzzles in batch mode
+ *
+ * returns: the time in seconds
+*/
+double WallSeconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+ * Function: CorpusOpen
+ * --------------------
+ * Map a puzzle corpus into memory read-only. Nothing is read but the header, the pages of the records are loaded when
+ * they are first touched.
+ *
+ * path: the corpus file
+ * corpus: filled with the mapping
+ *
+ * returns: 1 if path is a valid corpus, otherwise, return 0 (the file may be a text puzzle file)
+*/
+int CorpusOpen(const char *path, struct Corpus *corpus)
+{
+    memset(corpus, 0, sizeof(*corpus));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct CorpusHeader))
+    {
+        close(fd);
+        return 0;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the file is closed
+    close(fd);
+    if (base == MAP_FAILED)
+    {
+        return 0;
+    }
+    const struct CorpusHeader *header = base;
+    if (memcmp(header->magic, CORPUS_MAGIC, 4) != 0 || header->version != CORPUS_VERSION ||
+        header->headerSize != sizeof(struct CorpusHeader) || header->recordSize != sizeof(struct Task) ||
+        header->count > (st.st_size - sizeof(struct CorpusHeader)) / sizeof(struct Task))
+    {
+        if (memcmp(header->magic, CORPUS_MAGIC, 4) == 0)
+        {
+            fprintf(stderr, "%s is a corpus of another version or grid size, or it is truncated!\n", path);
+        }
+        munmap(base, st.st_size);
+        return 0;
+    }
+    corpus->base = base;
+    corpus->size = st.st_size;
+    corpus->tasks = (const struct Task *)((const char *)base + header->headerSize);
+    corpus->count = header->count;
+    return 1;
+}
+
+/*
+ * Function: CorpusClose
+ * --------------------
+ * Unmap a corpus opened by CorpusOpen
+ *
+ * corpus: the corpus
+*/
+void CorpusClose(struct Corpus *corpus)
+{
+    if (corpus->base)
+    {
+        munmap(corpus->base, corpus->size);
+    }
+    memset(corpus, 0, sizeof(*corpus));
+}
+
+/*
+ * Function: CorpusWriteHeader
+ * --------------------
+ * Write the header of a puzzle corpus at the current position of the stream, the records follow it
+ *
+ * out: the output stream
+ * count: the number of records
+ *
+ * returns: 1 if the header is written, otherwise, return 0
+*/
+int CorpusWriteHeader(FILE *out, long long count)
+{
+    struct CorpusHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CORPUS_MAGIC, 4);
+    header.version = CORPUS_VERSION;
+    header.headerSize = sizeof(struct CorpusHeader);
+    header.recordSize = sizeof(struct Task);
+    header.count = count;
+    return fwrite(&header, sizeof(header), 1, out) == 1;
+}
+
+// The solutions of one thread not written yet, see SolutionsWrite
+struct SolutionBuffer
+{
+    struct Task records[SOLUTION_BUFFER];
+    int n;
+    struct SolutionBuffer *next; // The buffers of all the threads are linked, so SolutionsClose can write what is left in them
+};
+
+// The file opened by SolutionsOpen, NULL when the solutions are not written
+static FILE *solutionsOut = NULL;
+
+// The buffers of all the threads which wrote a solution, linked under the lock of solutionsOut
+static struct SolutionBuffer *solutionsBuffers = NULL;
+
+// The buffer of the calling thread
+static _Thread_local struct SolutionBuffer *solutionsBuffer = NULL;
+
+// The number of solutions passed to SolutionsWrite, and 1 once a write has failed
+static atomic_llong solutionsCount;
+static atomic_int solutionsFailed;
+
+/*
+ * Function: SolutionsOpen
+ * --------------------
+ * Create the file of the solutions written by SolutionsWrite, a corpus whose header gets the final count in SolutionsClose
+ *
+ * path: the file name
+ *
+ * returns: 1 if the file is created, otherwise, return 0
+*/
+int SolutionsOpen(const char *path)
+{
+    solutionsOut = fopen(path, "wb");
+    if (!solutionsOut)
+    {
+        return 0;
+    }
+    atomic_store(&solutionsCount, 0);
+    atomic_store(&solutionsFailed, !CorpusWriteHeader(solutionsOut, 0));
+    return 1;
+}
+
+/*
+ * Function: SolutionsFlush
+ * --------------------
+ * Append the records of a buffer to the file and empty it. The stream is locked around the fwrite, so the buffers of
+ * the threads are written whole, one after the other.
+ *
+ * buffer: the buffer
+*/
+static void SolutionsFlush(struct SolutionBuffer *buffer)
+{
+    flockfile(solutionsOut);
+    if (fwrite(buffer->records, sizeof(struct Task), buffer->n, solutionsOut) != (size_t)buffer->n)
+    {
+        atomic_store(&solutionsFailed, 1);
+    }
+    funlockfile(solutionsOut);
+    buffer->n = 0;
+}
+
+/*
+ * Function: SolutionsWrite
+ * --------------------
+ * Installed as SolverOptions.onSolution, pack a solution into the buffer of the calling thread, and write the buffer
+ * once it is full. May be called by many threads at once.
+ *
+ * map[]: the solution
+*/
+void SolutionsWrite(char map[])
+{
+    struct SolutionBuffer *buffer = solutionsBuffer;
+    if (!buffer)
+    {
+        buffer = malloc(sizeof(struct SolutionBuffer));
+        if (!buffer)
+        {
+            atomic_store(&solutionsFailed, 1);
+            return;
+        }
+        buffer->n = 0;
+        flockfile(solutionsOut);
+        buffer->next = solutionsBuffers;
+        solutionsBuffers = buffer;
+        funlockfile(solutionsOut);
+        solutionsBuffer = buffer;
+    }
+    PackMap(map, buffer->records[buffer->n++].grid);
+    atomic_fetch_add_explicit(&solutionsCount, 1, memory_order_relaxed);
+    if (buffer->n == SOLUTION_BUFFER)
+    {
+        SolutionsFlush(buffer);
+    }
+}
+
+/*
+ * Function: SolutionsClose
+ * --------------------
+ * Write the solutions left in the buffers, write the header again with the final count and close the file. The threads
+ * which called SolutionsWrite must be done with it.
+ *
+ * returns: the number of solutions written, -1 if the file could not be written
+*/
+long long SolutionsClose(void)
+{
+    while (solutionsBuffers)
+    {
+        struct SolutionBuffer *buffer = solutionsBuffers;
+        solutionsBuffers = buffer->next;
+        SolutionsFlush(buffer);
+        free(buffer);
+    }
+    solutionsBuffer = NULL;
+    long long count = atomic_load(&solutionsCount);
+    int ok = !atomic_load(&solutionsFailed);
+    ok = ok && fseek(solutionsOut, 0, SEEK_SET) == 0 && CorpusWriteHeader(solutionsOut, count);
+    ok = fclose(solutionsOut) == 0 && ok;
+    solutionsOut = NULL;
+    return ok ? count : -1;
+}
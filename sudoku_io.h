@@ -0,0 +1,97 @@
+#ifndef SUDOKU_IO_H
+#define SUDOKU_IO_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "sudoku_solver.h"
+
+/*
+ * Puzzle streams for the batch mode (--batch=FILE) of sudoku_serial and the MPI program.
+ *
+ * A puzzle file holds one puzzle per line, in either format:
+ * - SUDOKU_CELLS characters in row-major order, '1'-'9' for the givens and '0' or '.' for the blank cells, the values
+ *   above 9 of the 16x16 and 25x25 grids are the letters 'A' (10) to 'P' (25)
+ * - the coordinates and values as on the command line, "x y value x y value ..."
+ * Empty lines and lines starting with '#' are skipped. FILE "-" reads the puzzles from stdin.
+ *
+ * Every puzzle gets one line of output "index solutions milliseconds", index counting the puzzles from 1 in input order,
+ * or "index invalid" when the line can not be read as a puzzle.
+ *
+ * A puzzle corpus is the binary form of a puzzle file, written by sudoku_pack: a struct CorpusHeader followed by one
+ * struct Task record (PackMap, 4 bits per cell, 8 bits for the larger grids) per puzzle. The records have a fixed size, so record i is at
+ * headerSize + i * recordSize and the file needs no other index. CorpusOpen maps the file into memory, and the records
+ * are read in place, a process only touches the pages of the puzzles it solves. The header is in the byte order of the
+ * machine which wrote it, a corpus with another byte order is rejected. --batch=FILE reads FILE as a corpus when it is one.
+ * The lines which are not puzzles are left out of a corpus, so its indexes count the valid puzzles only.
+ * The record size differs for every grid size, so a corpus packed by a build for another grid size is rejected too.
+ *
+ * The solutions of a puzzle (--solutions=FILE) are written in the same corpus format, one record per solution, so they
+ * can be read back with CorpusOpen or solved again with --batch. SolutionsWrite is the onSolution hook of the solver:
+ * every thread packs its solutions into a buffer of its own and appends the whole buffer to the file with one fwrite,
+ * so enumerating millions of solutions costs a PackMap per solution instead of a formatted print.
+*/
+
+// The longest line accepted in a puzzle file, SUDOKU_CELLS triples with their separators fit
+#define PUZZLE_LINE_MAX (SUDOKU_CELLS * 9 + 300)
+
+// Result of ReadPuzzle
+#define PUZZLE_END 0     // No puzzle left
+#define PUZZLE_OK 1      // map[] is filled with the next puzzle
+#define PUZZLE_INVALID 2 // The next line is not a puzzle, it still takes an index
+
+// Solutions buffered by every thread before SolutionsWrite appends them to the file
+#define SOLUTION_BUFFER 4096
+
+// First bytes of a puzzle corpus, and the version of its layout
+#define CORPUS_MAGIC "SDKC"
+#define CORPUS_VERSION 1
+
+struct CorpusHeader
+{
+    char magic[4];       // CORPUS_MAGIC
+    uint32_t version;    // CORPUS_VERSION
+    uint32_t headerSize; // sizeof(struct CorpusHeader), the offset of the first record
+    uint32_t recordSize; // sizeof(struct Task)
+    uint64_t count;      // The number of records
+};
+
+// A puzzle corpus mapped into memory by CorpusOpen
+struct Corpus
+{
+    void *base;                // The mapping of the whole file
+    size_t size;               // The size of the mapping
+    const struct Task *tasks;  // The records, tasks[i] is puzzle i + 1
+    long long count;           // The number of records
+};
+
+FILE *OpenPuzzles(const char *path);
+
+void ClosePuzzles(FILE *in);
+
+int ParsePuzzle(const char *line, int len, char map[]);
+
+int ReadPuzzleLine(FILE *in, char line[], int *len);
+
+int ReadPuzzle(FILE *in, char map[]);
+
+void PrintPuzzle(FILE *out, const char map[]);
+
+void PrintPuzzleResult(FILE *out, long long index, long long count, double seconds);
+
+void PrintFindResult(FILE *out, long long count, long long limit);
+
+double WallSeconds(void);
+
+int CorpusOpen(const char *path, struct Corpus *corpus);
+
+void CorpusClose(struct Corpus *corpus);
+
+int CorpusWriteHeader(FILE *out, long long count);
+
+int SolutionsOpen(const char *path);
+
+void SolutionsWrite(char map[]);
+
+long long SolutionsClose(void);
+
+#endif
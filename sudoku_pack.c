@@ -0,0 +1,81 @@
+#include "sudoku_io.h"
+#include "sudoku_solver.h"
+#include <string.h>
+
+// Records read, checked and written at a time
+#define PACK_BLOCK 4096
+
+/*
+ * sudoku_pack: convert a text puzzle file into the binary puzzle corpus read by --batch=FILE, see sudoku_io.h
+ *
+ * ./sudoku_pack puzzles.txt puzzles.sdk
+ * ./sudoku_pack - puzzles.sdk < puzzles.txt
+*/
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        printf("Usage: %s INPUT OUTPUT, INPUT - reads the puzzles from stdin\n", argv[0]);
+        return 1;
+    }
+    FILE *in = OpenPuzzles(argv[1]);
+    if (!in)
+    {
+        printf("Can not open %s!\n", argv[1]);
+        return 1;
+    }
+    FILE *out = fopen(argv[2], "wb");
+    if (!out)
+    {
+        printf("Can not open %s!\n", argv[2]);
+        ClosePuzzles(in);
+        return 1;
+    }
+
+    // The header is written again with the final count once every record is written
+    char map[SUDOKU_CELLS];
+    static struct Task block[PACK_BLOCK];
+    static unsigned char valid[PACK_BLOCK];
+    int n = 0;
+    long long count = 0;
+    long long skipped = 0;
+    long long conflicts = 0;
+    int status = PUZZLE_OK;
+    int ok = CorpusWriteHeader(out, 0);
+    while (ok && status != PUZZLE_END)
+    {
+        status = ReadPuzzle(in, map);
+        if (status == PUZZLE_INVALID)
+        {
+            skipped++;
+            continue;
+        }
+        if (status == PUZZLE_OK)
+        {
+            PackMap(map, block[n++].grid);
+        }
+        if (n == PACK_BLOCK || (status == PUZZLE_END && n > 0))
+        {
+            // The puzzles with conflicting givens are kept, they have no solution but they take an index
+            conflicts += n - SolverCheckTasks(block, n, valid);
+            ok = fwrite(block, sizeof(struct Task), n, out) == (size_t)n;
+            count += n;
+            n = 0;
+        }
+    }
+    ok = ok && fseek(out, 0, SEEK_SET) == 0 && CorpusWriteHeader(out, count);
+    ok = fclose(out) == 0 && ok;
+    ClosePuzzles(in);
+    if (!ok)
+    {
+        printf("Failed to write %s!\n", argv[2]);
+        return 1;
+    }
+    printf("The num of puzzles is %lld, %lld lines are not puzzles and are skipped.\n", count, skipped);
+    if (conflicts > 0)
+    {
+        printf("%lld puzzles have conflicting givens, they have no solution.\n", conflicts);
+    }
+    return 0;
+}
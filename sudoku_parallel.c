@@ -1,4 +1,5 @@
 #include "sudoku_parallel.h"
+#include "sudoku_solver.h"
 
 /*
  *
@@ -53,7 +54,7 @@
 */
 void SetCellValue(int x, int y, char value, char map[])
 {
-    int index = (x - 1) * 9 + y - 1;
+    int index = (x - 1) * SUDOKU_SIZE + y - 1;
     map[index] = value;
 }
 
@@ -69,7 +70,7 @@ void SetCellValue(int x, int y, char value, char map[])
 */
 char GetCellValue(int x, int y, char map[])
 {
-    int index = (x - 1) * 9 + y - 1;
+    int index = (x - 1) * SUDOKU_SIZE + y - 1;
     return map[index];
 }
 
@@ -89,7 +90,7 @@ int RowColumnCheckDup(int x, int y, char value, char map[])
     int i = 0;
 
     // If there are at least 2 cells in the column y with same value, return 0
-    for (i = 1; i <= 9; i++)
+    for (i = 1; i <= SUDOKU_SIZE; i++)
     {
         if (GetCellValue(i, y, map) == value)
         {
@@ -99,7 +100,7 @@ int RowColumnCheckDup(int x, int y, char value, char map[])
     }
 
     // If there are at least 2 cells in the row x with same value, return 0
-    for (i = 1; i <= 9; i++)
+    for (i = 1; i <= SUDOKU_SIZE; i++)
     {
         if (GetCellValue(x, i, map) == value)
         {
@@ -113,7 +114,7 @@ int RowColumnCheckDup(int x, int y, char value, char map[])
 /*
  * Function: BoxCheckDup 
  * --------------------
- * Check whether there are duplicated values in each small box (1 sudoku has 9 small boxes)
+ * Check whether there are duplicated values in each small box (1 sudoku has SUDOKU_SIZE small boxes)
  *
  * x, y: coordinate of cell (x, y)
  * value: the value of cell (x, y)
@@ -123,11 +124,11 @@ int RowColumnCheckDup(int x, int y, char value, char map[])
 */
 int BoxCheckDup(int x, int y, int value, char map[])
 {
-    int i = (x - 1) / 3;
-    int j = (y - 1) / 3;
-    for (int a = i * 3 + 1; a < i * 3 + 3 + 1; a++)
+    int i = (x - 1) / SUDOKU_BOX;
+    int j = (y - 1) / SUDOKU_BOX;
+    for (int a = i * SUDOKU_BOX + 1; a < i * SUDOKU_BOX + SUDOKU_BOX + 1; a++)
     {
-        for (int b = j * 3 + 1; b < j * 3 + 3 + 1; b++)
+        for (int b = j * SUDOKU_BOX + 1; b < j * SUDOKU_BOX + SUDOKU_BOX + 1; b++)
         {
             if (GetCellValue(a, b, map) == value)
             {
@@ -158,7 +159,9 @@ int IsValid(int x, int y, int value, char map[])
 /*
  * Function: SudokuMapCheck 
  * --------------------
- * Check the result of AND operation of the results of BoxCheckDup function and RowColumnCheckDup function, namely IsValid function above for each cell in sudoku map
+ * Check that no value is given twice in a row, a column or a small box of the sudoku map. The givens are checked in one
+ * pass with the row, column and box masks of SolverCheck in sudoku_check.c, instead of calling IsValid on every given
+ * cell, which rescans its row, column and box.
  *
  * map[]: sudoku map array
  *
@@ -166,24 +169,7 @@ int IsValid(int x, int y, int value, char map[])
 */
 int SudokuMapCheck(char map[])
 {
-    int i, j;
-    i = 0;
-    j = 0;
-    for (i = 1; i < 10; i++)
-    {
-        for (j = 1; j < 10; j++)
-        {
-            int value = GetCellValue(i, j, map);
-            // In ParseArgv function, the cells without inputting values from the user will be filled in 0.
-            // In this function, only the cells with inputting values from the user need to be checked
-            if (value != 0)
-            {
-                if (!IsValid(i, j, value, map))
-                    return 0;
-            }
-        }
-    }
-    return 1;
+    return SolverCheck(map);
 }
 
 /*
@@ -197,37 +183,37 @@ void SudokuPrint(char map[])
 {
     int i, j;
     i = j = 0;
-    for (j = 1; j <= 9; j++)
+    for (j = 1; j <= SUDOKU_SIZE; j++)
     {
         printf("---");
-        if (j % 3 == 0)
+        if (j % SUDOKU_BOX == 0)
         {
             printf("|");
         }
     }
     printf("\n");
-    for (i = 1; i <= 9; i++)
+    for (i = 1; i <= SUDOKU_SIZE; i++)
     {
-        for (j = 1; j <= 9; j++)
+        for (j = 1; j <= SUDOKU_SIZE; j++)
         {
             int value = GetCellValue(i, j, map);
             // In ParseArgv function, the cells without inputting values from the user will be filled in 0, which should not be printed
             if (value == 0)
                 printf("   ");
             else
-                printf(" %d ", GetCellValue(i, j, map));
-            if (j % 3 == 0)
+                printf("%2d ", GetCellValue(i, j, map));
+            if (j % SUDOKU_BOX == 0)
             {
                 printf("|");
             }
         }
-        if (i % 3 == 0)
+        if (i % SUDOKU_BOX == 0)
         {
             printf("\n");
-            for (j = 1; j <= 9; j++)
+            for (j = 1; j <= SUDOKU_SIZE; j++)
             {
                 printf("---");
-                if (j % 3 == 0)
+                if (j % SUDOKU_BOX == 0)
                 {
                     printf("|");
                 }
@@ -242,78 +228,35 @@ void SudokuPrint(char map[])
  * Function: SudokuSolution 
  * --------------------
  * Figure out the possible solution for sudoku puzzle by travesing all the blank cells, trying to fill 1-9 in the blank cells one by one, and checking whether the numbers are reasonable. 
+ * The candidates of each blank cell are taken from the row, column and box occupancy masks of SolverCount in sudoku_solver.c, instead of scanning the map with IsValid for every number.
  *
  * map[]: sudoku map array
  *
- * returns: return 0 if there is no reasonable solution to the sudoku puzzle, otherwise, return 1.
+ * returns: the number of solutions to the sudoku puzzle, 0 if there is no reasonable solution.
 */
-int SudokuSolution(char map[])
+long long SudokuSolution(char map[])
 {
-    int count = 0;
-    if (!SudokuMapCheck(map))
-    {
-        return count;
-    }
-    // Define a two-dimensional array with 81 rows (as there are 81 cells at maximum) and 2 columns, to record the coordinate of the cells without inputting values from the user in the two-dimensional array
-    int as[81][2] = {{0}};
-    // Define a variable, to record the number of cells which need to be filled in
-    int step = 0;
-    // Traverse all the cells in the sudoku map and store the corresponding info in the as[81][2] and step
-    for (int i = 1; i < 10; i++)
-    {
-        for (int j = 1; j < 10; j++)
-        {
-            if (GetCellValue(i, j, map) == 0)
-            {
-                as[step][0] = i;
-                as[step][1] = j;
-                step++;
-            }
-        }
-    }
-    // Use "pos" to traverse all the blank cells and try to fill cur+1 or 0 in, cur range from 0 to 8
-    int pos = 0;
-    while (pos >= 0 && pos <= step)
-    {
-        int x = as[pos][0];
-        int y = as[pos][1];
-        int cur = GetCellValue(x, y, map);
+    // The options (order of the blank cells, SolverConfig.onSolution = SudokuPrint to print every solution) are parsed in main
+    return SolverCount(map, &SolverConfig, &SolverTotals);
+}
 
-        if (cur < 9)
-        {
-            // Try to get a reasonable cur through IsValid function
-            while (IsValid(x, y, cur + 1, map) == 0)
-            {
-                cur++;
-            }
-            // If there is a possibly reasonable cur found, fill cur+1 in the current cell, and repeat same process for the next cell after pos++
-            if (cur < 9)
-            {
-                SetCellValue(x, y, cur + 1, map);
-                pos++;
-            }
-            // If there is no possibly reasonable cur found, fill 0 in the current cell and which also means the number filled in last cell was wrong, will try the next possibly reasonable value (namely the number + 1) in the last cell
-            else
-            {
-                SetCellValue(x, y, 0, map);
-                pos--;
-            }
-        }
-        // If the value in the current cell is 9, which means there is no possible values could be tried anymore, fill 0 in the current cell and which also means the number filled in last cell was wrong, will try the next possibly reasonable value (namely the number + 1) in the last cell
-        else
-        {
-            SetCellValue(x, y, 0, map);
-            pos--;
-        }
-        // When pos equals step, a valid solution for the sudoku puzzle is found successfully 
-        if (pos == step)
-        {
-            count++;
-            // Print the full sudoku map after the calculation
-            // SudokuPrint(map);
-        }
-    }
-    return count;
+/*
+ * Function: SudokuSolutionBatch 
+ * --------------------
+ * Figure out the number of solutions of many independent sudoku puzzles at once. The puzzles are propagated in lockstep, SOLVER_LANES at a
+ * time, by SolverCountTasks in sudoku_batch.c, and only the ones which need branching are searched like in SudokuSolution.
+ *
+ * tasks[]: the puzzles, packed by PackMap
+ * n: the number of puzzles
+ * counts[]: filled with the number of solutions to every puzzle
+ * seconds[]: filled with the time spent on every puzzle, may be NULL
+ * firsts[]: filled with the first solution of every puzzle which has one, for the result cache, may be NULL
+ *
+ * returns: the total number of solutions to the puzzles
+*/
+long long SudokuSolutionBatch(const struct Task tasks[], int n, long long counts[], double seconds[], struct Task firsts[])
+{
+    return SolverCountTasks(tasks, n, &SolverConfig, &SolverTotals, counts, seconds, firsts);
 }
 
 /*
@@ -342,7 +285,7 @@ int ParseArgv(int argc, char **argv, char map[])
     }
 
     // Initiate map with 0
-    memset(map, 0, sizeof(char) * 81);
+    memset(map, 0, sizeof(char) * SUDOKU_CELLS);
 
     // Check if argv is valid
     for (int i = 1; i < argc; i += 3)
@@ -350,7 +293,7 @@ int ParseArgv(int argc, char **argv, char map[])
         int x = atoi(argv[i]);
         int y = atoi(argv[i + 1]);
         char value = atoi(argv[i + 2]);
-        if (x < 1 || x > 9 || y < 1 || y > 9 || value < 1 || value > 9)
+        if (x < 1 || x > SUDOKU_SIZE || y < 1 || y > SUDOKU_SIZE || value < 1 || value > SUDOKU_SIZE)
         {
             return 0;
         }
@@ -363,13 +306,14 @@ int ParseArgv(int argc, char **argv, char map[])
 /*
  * Function: GetTime 
  * --------------------
- * Get the current time
+ * Get the current time from the monotonic clock, which does not jump when the system time is set, with a resolution well below the
+ * millisecond, so that short runs can be timed and compared
  * 
- * returns: the current time
+ * returns: the current time in milliseconds
 */
-long long GetTime()
+double GetTime()
 {
-    struct timeval tv;
-    gettimeofday(&tv, 0);
-    return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <time.h>
 #include <sys/time.h>
+#include "sudoku_solver.h"
 
 void SetCellValue(int x, int y, char value, char map[]);
 
@@ -18,8 +19,10 @@ int SudokuMapCheck(char map[]);
 
 void SudokuPrint(char map[]);
 
-int SudokuSolution( char map[]);
+long long SudokuSolution(char map[]);
+
+long long SudokuSolutionBatch(const struct Task tasks[], int n, long long counts[], double seconds[], struct Task firsts[]);
 
 int ParseArgv(int argc, char **argv, char map[]);
 
-long long GetTime();
\ No newline at end of file
+double GetTime();
\ No newline at end of file
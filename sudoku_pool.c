@@ -0,0 +1,410 @@
+#include "sudoku_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// A worker without a task sleeps POOL_IDLE_NANOSECONDS before it looks at the deque again
+#define POOL_IDLE_NANOSECONDS 100000
+
+// The state of a worker thread, only written by the worker until it is joined
+struct PoolWorker
+{
+    pthread_t thread;
+    long long count;          // The number of solutions found
+    int tasks;                // The number of tasks solved
+    long long slowest;        // The time of its longest task, in nanoseconds
+    struct SolverStats stats; // The counters of its SolverCount calls
+};
+
+struct Pool
+{
+    int threads;
+    struct SolverOptions options; // Copied by every worker, with onPoll replaced by PoolPoll
+    struct PoolWorker *workers;
+
+    // The deque, tasks[top..bottom-1] modulo POOL_CAPACITY, the owner pushes and takes back at bottom, the workers steal at top.
+    // The records and the two ends are only changed under lock, top and bottom are atomic so PoolSize can read them without it.
+    struct Task tasks[POOL_CAPACITY];
+    atomic_long top;
+    atomic_long bottom;
+
+    atomic_int active; // The number of workers which hold a task, or are trying to steal one
+    atomic_int stop;   // Set by PoolStop, the workers leave once the deque is empty
+    atomic_int want;   // Set by PoolAskDonation, cleared by the first worker which gives away part of its search
+
+    // Guards the deque, and the tasks given away by the workers, moved into the deque by the owner in PoolBalance
+    pthread_mutex_t lock;
+    struct Task donated[POOL_CAPACITY];
+    int donatedNum;
+    atomic_int pending; // A copy of donatedNum which can be read without the lock
+
+    // The cost of the tasks finished since the last PoolTiming call
+    atomic_int done;
+    atomic_llong nanoseconds;
+
+    long long slowest; // The time of the longest task of the workers, in nanoseconds, set by PoolStop
+};
+
+static struct Pool pool;
+
+/*
+ * Function: Nanoseconds
+ * --------------------
+ * Read the monotonic clock
+ *
+ * returns: the time in nanoseconds
+*/
+static long long Nanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/*
+ * Function: PoolSteal
+ * --------------------
+ * Take the oldest task of the deque, called by the workers. Every task is a whole SolverCount subtree, so taking the lock
+ * once per task costs nothing next to solving it, and the record can not be overwritten by PoolPush while it is copied.
+ *
+ * task: filled with the task
+ *
+ * returns: 1 if a task is taken, 0 if the deque is empty
+*/
+static int PoolSteal(struct Task *task)
+{
+    pthread_mutex_lock(&pool.lock);
+    long t = atomic_load_explicit(&pool.top, memory_order_relaxed);
+    long b = atomic_load_explicit(&pool.bottom, memory_order_relaxed);
+    int taken = t < b;
+    if (taken)
+    {
+        *task = pool.tasks[t % POOL_CAPACITY];
+        atomic_store_explicit(&pool.top, t + 1, memory_order_release);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return taken;
+}
+
+/*
+ * Function: PushLocked
+ * --------------------
+ * Append tasks to the owner's end of the deque, pool.lock must be held
+ *
+ * tasks[]: the tasks
+ * n: the number of tasks
+ *
+ * returns: the number of tasks pushed, less than n when the deque is full
+*/
+static int PushLocked(const struct Task tasks[], int n)
+{
+    long b = atomic_load_explicit(&pool.bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&pool.top, memory_order_relaxed);
+    if (n > POOL_CAPACITY - (b - t))
+    {
+        n = POOL_CAPACITY - (b - t);
+    }
+    for (int i = 0; i < n; i++)
+    {
+        pool.tasks[(b + i) % POOL_CAPACITY] = tasks[i];
+    }
+    atomic_store_explicit(&pool.bottom, b + n, memory_order_release);
+    return n;
+}
+
+/*
+ * Function: PoolPoll
+ * --------------------
+ * Installed as options.onPoll of the workers. When PoolAskDonation was called, the first worker to notice gives away the
+ * untried values at the top of its search, unless the donated tasks would not fit in the pool.
+*/
+static void PoolPoll(void)
+{
+    int expected = 1;
+    if (!atomic_load_explicit(&pool.want, memory_order_relaxed) ||
+        !atomic_compare_exchange_strong(&pool.want, &expected, 0))
+    {
+        return;
+    }
+    pthread_mutex_lock(&pool.lock);
+    int max = POOL_CAPACITY - pool.donatedNum;
+    if (max > SUDOKU_SIZE)
+    {
+        max = SUDOKU_SIZE;
+    }
+    pool.donatedNum += SolverDonate(pool.donated + pool.donatedNum, max);
+    atomic_store(&pool.pending, pool.donatedNum);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+/*
+ * Function: PoolRun
+ * --------------------
+ * Body of a worker thread, solve the tasks of the deque until PoolStop is called and the deque is empty
+ *
+ * arg: the struct PoolWorker of the thread
+ *
+ * returns: NULL
+*/
+static void *PoolRun(void *arg)
+{
+    struct PoolWorker *self = arg;
+    struct SolverOptions options = pool.options;
+    options.onPoll = PoolPoll;
+    struct timespec idle = {0, POOL_IDLE_NANOSECONDS};
+    while (1)
+    {
+        // active is raised before the deque is read, so the owner never sees an empty deque and no active worker while a task is in flight
+        atomic_fetch_add(&pool.active, 1);
+        struct Task task;
+        int taken = PoolSteal(&task);
+        if (taken)
+        {
+            char map[SUDOKU_CELLS];
+            long long start = Nanoseconds();
+            UnpackMap(task.grid, map);
+            self->count += SolverCount(map, &options, &self->stats);
+            self->tasks++;
+            long long spent = Nanoseconds() - start;
+            self->slowest = spent > self->slowest ? spent : self->slowest;
+            atomic_fetch_add(&pool.nanoseconds, spent);
+            atomic_fetch_add(&pool.done, 1);
+        }
+        atomic_fetch_sub(&pool.active, 1);
+        if (!taken)
+        {
+            if (atomic_load(&pool.stop))
+            {
+                break;
+            }
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Function: PoolStart
+ * --------------------
+ * Start the worker threads with an empty deque
+ *
+ * threads: the number of worker threads
+ * options: the solver options of the workers, copied
+ *
+ * returns: 1 if all the threads are started, otherwise, return 0
+*/
+int PoolStart(int threads, const struct SolverOptions *options)
+{
+    pool.threads = threads;
+    pool.options = *options;
+    pool.workers = calloc(threads, sizeof(struct PoolWorker));
+    atomic_init(&pool.top, 0);
+    atomic_init(&pool.bottom, 0);
+    atomic_init(&pool.active, 0);
+    atomic_init(&pool.stop, 0);
+    atomic_init(&pool.want, 0);
+    atomic_init(&pool.pending, 0);
+    atomic_init(&pool.done, 0);
+    atomic_init(&pool.nanoseconds, 0);
+    pool.donatedNum = 0;
+    if (!pool.workers || pthread_mutex_init(&pool.lock, NULL) != 0)
+    {
+        return 0;
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        if (pthread_create(&pool.workers[i].thread, NULL, PoolRun, &pool.workers[i]) != 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Function: PoolPush
+ * --------------------
+ * Append tasks to the owner's end of the deque
+ *
+ * tasks[]: the tasks
+ * n: the number of tasks
+ *
+ * returns: the number of tasks pushed, less than n when the deque is full
+*/
+int PoolPush(const struct Task tasks[], int n)
+{
+    pthread_mutex_lock(&pool.lock);
+    n = PushLocked(tasks, n);
+    pthread_mutex_unlock(&pool.lock);
+    return n;
+}
+
+/*
+ * Function: PoolTakeBack
+ * --------------------
+ * Take the newest tasks, which no worker has started, back from the owner's end of the deque
+ *
+ * tasks[]: filled with the tasks
+ * max: the maximum number of tasks
+ *
+ * returns: the number of tasks taken
+*/
+int PoolTakeBack(struct Task tasks[], int max)
+{
+    pthread_mutex_lock(&pool.lock);
+    long b = atomic_load_explicit(&pool.bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&pool.top, memory_order_relaxed);
+    int n = 0;
+    while (n < max && b > t)
+    {
+        b--;
+        tasks[n++] = pool.tasks[b % POOL_CAPACITY];
+    }
+    atomic_store_explicit(&pool.bottom, b, memory_order_release);
+    pthread_mutex_unlock(&pool.lock);
+    return n;
+}
+
+/*
+ * Function: PoolSize
+ * --------------------
+ * returns: the number of tasks in the deque
+*/
+int PoolSize(void)
+{
+    long b = atomic_load(&pool.bottom);
+    long t = atomic_load(&pool.top);
+    return b > t ? (int)(b - t) : 0;
+}
+
+/*
+ * Function: PoolIdle
+ * --------------------
+ * returns: the number of workers without a task
+*/
+int PoolIdle(void)
+{
+    return pool.threads - atomic_load(&pool.active);
+}
+
+/*
+ * Function: PoolAskDonation
+ * --------------------
+ * Ask the next busy worker which reaches its onPoll to give away part of its search
+*/
+void PoolAskDonation(void)
+{
+    atomic_store(&pool.want, 1);
+}
+
+/*
+ * Function: PoolBalance
+ * --------------------
+ * Move the tasks given away by the workers into the deque, and when a worker is idle while the deque is empty, ask the
+ * busy ones to give away part of their search. Called regularly by the owner.
+*/
+void PoolBalance(void)
+{
+    if (atomic_load(&pool.pending) > 0)
+    {
+        pthread_mutex_lock(&pool.lock);
+        int n = PushLocked(pool.donated, pool.donatedNum);
+        memmove(pool.donated, pool.donated + n, (pool.donatedNum - n) * sizeof(struct Task));
+        pool.donatedNum -= n;
+        atomic_store(&pool.pending, pool.donatedNum);
+        pthread_mutex_unlock(&pool.lock);
+    }
+    if (PoolSize() == 0 && PoolIdle() > 0)
+    {
+        PoolAskDonation();
+    }
+}
+
+/*
+ * Function: PoolFinished
+ * --------------------
+ * returns: 1 if no worker holds a task and there is no task left in the pool, otherwise, return 0
+*/
+int PoolFinished(void)
+{
+    // A worker raises active before it takes a task and gives its tasks away before it lowers active, so read active first
+    if (atomic_load(&pool.active) > 0)
+    {
+        return 0;
+    }
+    return PoolSize() == 0 && atomic_load(&pool.pending) == 0;
+}
+
+/*
+ * Function: PoolTiming
+ * --------------------
+ * Read and reset the cost of the tasks finished since the last call, the seconds of all the workers are added
+ *
+ * done: the number of tasks
+ * seconds: the time spent on them
+*/
+void PoolTiming(int *done, double *seconds)
+{
+    *done = atomic_exchange(&pool.done, 0);
+    *seconds = atomic_exchange(&pool.nanoseconds, 0) / 1e9;
+}
+
+/*
+ * Function: PoolStop
+ * --------------------
+ * Wait until every task of the pool, including the ones the workers give away meanwhile, is solved, then join the worker
+ * threads and add up their results, so only one count per process leaves the node
+ *
+ * stats: the counters of the workers are added to it, may be NULL
+ * tasks: the number of tasks solved by the workers is added to it, may be NULL
+ *
+ * returns: the number of solutions found by the workers
+*/
+long long PoolStop(struct SolverStats *stats, int *tasks)
+{
+    struct timespec idle = {0, POOL_IDLE_NANOSECONDS};
+    while (!PoolFinished())
+    {
+        PoolBalance();
+        nanosleep(&idle, NULL);
+    }
+    atomic_store(&pool.stop, 1);
+    long long count = 0;
+    pool.slowest = 0;
+    for (int i = 0; i < pool.threads; i++)
+    {
+        pthread_join(pool.workers[i].thread, NULL);
+        count += pool.workers[i].count;
+        pool.slowest = pool.workers[i].slowest > pool.slowest ? pool.workers[i].slowest : pool.slowest;
+        if (stats)
+        {
+            stats->nodes += pool.workers[i].stats.nodes;
+            stats->propagated += pool.workers[i].stats.propagated;
+            stats->backtracks += pool.workers[i].stats.backtracks;
+            stats->checks += pool.workers[i].stats.checks;
+        }
+        if (tasks)
+        {
+            *tasks += pool.workers[i].tasks;
+        }
+    }
+    pthread_mutex_destroy(&pool.lock);
+    free(pool.workers);
+    pool.workers = NULL;
+    return count;
+}
+
+/*
+ * Function: PoolSlowestTask
+ * --------------------
+ * Get the time of the longest task solved by the workers, valid after PoolStop
+ *
+ * returns: the time in seconds
+*/
+double PoolSlowestTask(void)
+{
+    return pool.slowest / 1e9;
+}
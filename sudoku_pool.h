@@ -0,0 +1,43 @@
+#ifndef SUDOKU_POOL_H
+#define SUDOKU_POOL_H
+
+#include "sudoku_solver.h"
+
+/*
+ * Node-local thread pool for the hybrid MPI + threads mode of the MPI program.
+ *
+ * One thread per process, the owner, talks to the other processes and pushes the tasks it receives into a bounded
+ * deque guarded by a mutex, taken once per task, which is a whole subtree of the search. The worker threads steal the
+ * tasks from the other end of the deque and count their solutions with SolverCount. The owner can take the tasks which have not been started back from its end, to give them
+ * to another process. When a worker is idle and the deque is empty, the busy workers are asked to give away the untried
+ * values at the top of their search (SolverDonate), so a hard task is shared by the threads of the node.
+ *
+ * Only the owner calls the Pool functions, there is one pool per process.
+*/
+
+// Maximum number of tasks queued in the deque, and waiting to be moved into it after a donation
+#define POOL_CAPACITY 1024
+
+int PoolStart(int threads, const struct SolverOptions *options);
+
+int PoolPush(const struct Task tasks[], int n);
+
+int PoolTakeBack(struct Task tasks[], int max);
+
+int PoolSize(void);
+
+int PoolIdle(void);
+
+void PoolBalance(void);
+
+void PoolAskDonation(void);
+
+int PoolFinished(void);
+
+void PoolTiming(int *done, double *seconds);
+
+long long PoolStop(struct SolverStats *stats, int *tasks);
+
+double PoolSlowestTask(void);
+
+#endif
@@ -0,0 +1,209 @@
+#include "sudoku_serve.h"
+#include "sudoku_io.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/*
+ * Function: ServeOpen
+ * --------------------
+ * Listen on a Unix-domain stream socket. A socket file left at path by a service which did not stop cleanly is replaced,
+ * any other file is not.
+ *
+ * path: the file name of the socket
+ *
+ * returns: the listening socket, -1 if it can not be created
+*/
+int ServeOpen(const char *path)
+{
+    struct sockaddr_un address;
+    struct stat st;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "The socket name %s is too long!\n", path);
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        unlink(path);
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+    {
+        fprintf(stderr, "Can not listen on %s: %s!\n", path, strerror(errno));
+        if (listener >= 0)
+        {
+            close(listener);
+        }
+        return -1;
+    }
+    return listener;
+}
+
+/*
+ * Function: ServeClose
+ * --------------------
+ * Stop listening and remove the socket file
+ *
+ * listener: the socket returned by ServeOpen
+ * path: the file name of the socket
+*/
+void ServeClose(int listener, const char *path)
+{
+    close(listener);
+    unlink(path);
+}
+
+/*
+ * Function: ServeAccept
+ * --------------------
+ * Wait for the next client, and open its connection as two streams, one to read the requests and one to write the replies
+ *
+ * listener: the socket returned by ServeOpen
+ * in, out: set to the streams of the connection, both are closed with fclose
+ *
+ * returns: 1 if a client is connected, otherwise, return 0
+*/
+int ServeAccept(int listener, FILE **in, FILE **out)
+{
+    int client;
+    do
+    {
+        client = accept(listener, NULL, NULL);
+    } while (client < 0 && errno == EINTR);
+    if (client < 0)
+    {
+        fprintf(stderr, "Can not accept a client: %s!\n", strerror(errno));
+        return 0;
+    }
+    int copy = dup(client);
+    *in = fdopen(client, "r");
+    *out = copy >= 0 ? fdopen(copy, "w") : NULL;
+    if (!*in || !*out)
+    {
+        fprintf(stderr, "Can not open the connection of a client!\n");
+        if (*in)
+        {
+            fclose(*in);
+        }
+        else
+        {
+            close(client);
+        }
+        if (*out)
+        {
+            fclose(*out);
+        }
+        else if (copy >= 0)
+        {
+            close(copy);
+        }
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Function: ServeRead
+ * --------------------
+ * Read the next request of a client, its options first, then its puzzle
+ *
+ * in: the stream of the requests
+ * defaults: the solver options of the service, changed by the options of the request for this puzzle only
+ * request: filled with the options of the request and the command SERVE_PUZZLE
+ * map[]: sudoku map array, filled with the puzzle
+ *
+ * returns: SERVE_PUZZLE, SERVE_INVALID if the next line is not a request, SERVE_SHUTDOWN or SERVE_END
+*/
+int ServeRead(FILE *in, const struct SolverOptions *defaults, struct ServeRequest *request, char map[])
+{
+    char line[PUZZLE_LINE_MAX];
+    int len;
+    int status = ReadPuzzleLine(in, line, &len);
+    if (status != PUZZLE_OK)
+    {
+        return status == PUZZLE_END ? SERVE_END : SERVE_INVALID;
+    }
+    if (strcmp(line, "shutdown") == 0)
+    {
+        return SERVE_SHUTDOWN;
+    }
+    struct SolverOptions options = *defaults;
+    int print = 0;
+    char *p = line;
+    while (strncmp(p, "--", 2) == 0)
+    {
+        char *end = p;
+        while (*end != '\0' && !isspace((unsigned char)*end))
+        {
+            end++;
+        }
+        char *next = *end != '\0' ? end + 1 : end;
+        *end = '\0';
+        if (strncmp(p, "--print=", 8) == 0)
+        {
+            char *last;
+            long n = strtol(p + 8, &last, 10);
+            if (last == p + 8 || *last != '\0' || n < 0 || n > SERVE_PRINT_MAX)
+            {
+                return SERVE_INVALID;
+            }
+            print = n;
+        }
+        else if (!ParseSolverOption(p, &options))
+        {
+            return SERVE_INVALID;
+        }
+        p = next;
+        while (isspace((unsigned char)*p))
+        {
+            p++;
+        }
+    }
+    if (!ParsePuzzle(p, len - (p - line), map))
+    {
+        return SERVE_INVALID;
+    }
+    request->command = SERVE_PUZZLE;
+    request->backend = options.backend;
+    request->order = options.order;
+    request->propagate = options.propagate;
+    request->limit = options.limit;
+    request->symmetry = options.symmetry;
+    request->print = print;
+    return SERVE_PUZZLE;
+}
+
+/*
+ * Function: ServeReply
+ * --------------------
+ * Write the reply to a request and send it at once
+ *
+ * out: the stream of the replies
+ * index: the index of the request in the connection, from 1
+ * count: the number of solutions, -1 if the request could not be read
+ * seconds: the time spent on the request
+ * solutions[]: the solutions to send back, packed by PackMap
+ * n: the number of solutions to send back
+ *
+ * returns: 1 if the reply is sent, 0 if the client is gone
+*/
+int ServeReply(FILE *out, long long index, long long count, double seconds, const struct Task solutions[], int n)
+{
+    char map[SUDOKU_CELLS];
+    PrintPuzzleResult(out, index, count, seconds);
+    for (int i = 0; i < n; i++)
+    {
+        UnpackMap(solutions[i].grid, map);
+        PrintPuzzle(out, map);
+    }
+    return fflush(out) == 0;
+}
@@ -0,0 +1,56 @@
+#ifndef SUDOKU_SERVE_H
+#define SUDOKU_SERVE_H
+
+#include <stdio.h>
+#include "sudoku_solver.h"
+
+/*
+ * The socket of the solver service, --serve=PATH of the MPI program.
+ *
+ * The MPI job stays up between the puzzles: rank 0 listens on a Unix-domain stream socket at PATH, and every request is
+ * solved by the resident processes as a single puzzle is, so a request costs its solve time instead of the start-up of
+ * mpirun and of every process. A client connects, writes its requests one per line and reads one reply per request, in
+ * order, for as long as it keeps the connection. The clients are served one at a time, the others wait in the backlog.
+ *
+ * A request is a puzzle line in either format of a puzzle file (sudoku_io.h), possibly preceded by options:
+ * - the solver options of the command line (--find=..., --order=..., --solver=..., --propagate, --symmetry), for this puzzle only
+ * - --print=N: send back up to N of the solutions, at most SERVE_PRINT_MAX
+ * The line "shutdown" stops the service. Empty lines and lines starting with '#' are skipped.
+ *
+ * The reply is the line "index solutions milliseconds" of the batch mode, index counting the requests of the connection
+ * from 1, followed by min(solutions, N) lines with one solution each, in the SUDOKU_CELLS characters format. A request
+ * which can not be read gets the line "index invalid".
+*/
+
+// The most solutions a request can ask for with --print=N
+#define SERVE_PRINT_MAX 10000
+
+// Result of ServeRead
+#define SERVE_END 0      // The client closed the connection
+#define SERVE_PUZZLE 1   // map[] and the request are filled with the next puzzle
+#define SERVE_INVALID 2  // The next line is not a request, it still takes an index
+#define SERVE_SHUTDOWN 3 // The client asked the service to stop
+
+// A request of a client, broadcast by rank 0 to every process before the puzzle is solved
+struct ServeRequest
+{
+    int command;     // SERVE_PUZZLE, or SERVE_SHUTDOWN to stop every process
+    int backend;     // The solver options of the request, see struct SolverOptions
+    int order;
+    int propagate;
+    long long limit;
+    int symmetry;
+    int print;       // The number of solutions to send back
+};
+
+int ServeOpen(const char *path);
+
+void ServeClose(int listener, const char *path);
+
+int ServeAccept(int listener, FILE **in, FILE **out);
+
+int ServeRead(FILE *in, const struct SolverOptions *defaults, struct ServeRequest *request, char map[]);
+
+int ServeReply(FILE *out, long long index, long long count, double seconds, const struct Task solutions[], int n);
+
+#endif
@@ -0,0 +1,1234 @@
+#include "sudoku_solver.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+struct SolverOptions SolverConfig = {SOLVER_BACKEND_BACKTRACK, SOLVER_ORDER_STATIC, 0, NULL, NULL, 0, 0};
+struct SolverStats SolverTotals = {0, 0, 0, 0};
+
+#if SUDOKU_BOX == 3
+const SudokuIndex UnitCells[3 * SUDOKU_SIZE][SUDOKU_SIZE] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8},
+    {9, 10, 11, 12, 13, 14, 15, 16, 17},
+    {18, 19, 20, 21, 22, 23, 24, 25, 26},
+    {27, 28, 29, 30, 31, 32, 33, 34, 35},
+    {36, 37, 38, 39, 40, 41, 42, 43, 44},
+    {45, 46, 47, 48, 49, 50, 51, 52, 53},
+    {54, 55, 56, 57, 58, 59, 60, 61, 62},
+    {63, 64, 65, 66, 67, 68, 69, 70, 71},
+    {72, 73, 74, 75, 76, 77, 78, 79, 80},
+    {0, 9, 18, 27, 36, 45, 54, 63, 72},
+    {1, 10, 19, 28, 37, 46, 55, 64, 73},
+    {2, 11, 20, 29, 38, 47, 56, 65, 74},
+    {3, 12, 21, 30, 39, 48, 57, 66, 75},
+    {4, 13, 22, 31, 40, 49, 58, 67, 76},
+    {5, 14, 23, 32, 41, 50, 59, 68, 77},
+    {6, 15, 24, 33, 42, 51, 60, 69, 78},
+    {7, 16, 25, 34, 43, 52, 61, 70, 79},
+    {8, 17, 26, 35, 44, 53, 62, 71, 80},
+    {0, 1, 2, 9, 10, 11, 18, 19, 20},
+    {3, 4, 5, 12, 13, 14, 21, 22, 23},
+    {6, 7, 8, 15, 16, 17, 24, 25, 26},
+    {27, 28, 29, 36, 37, 38, 45, 46, 47},
+    {30, 31, 32, 39, 40, 41, 48, 49, 50},
+    {33, 34, 35, 42, 43, 44, 51, 52, 53},
+    {54, 55, 56, 63, 64, 65, 72, 73, 74},
+    {57, 58, 59, 66, 67, 68, 75, 76, 77},
+    {60, 61, 62, 69, 70, 71, 78, 79, 80}};
+
+const unsigned char CellRow[SUDOKU_CELLS] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 2,
+    3, 3, 3, 3, 3, 3, 3, 3, 3,
+    4, 4, 4, 4, 4, 4, 4, 4, 4,
+    5, 5, 5, 5, 5, 5, 5, 5, 5,
+    6, 6, 6, 6, 6, 6, 6, 6, 6,
+    7, 7, 7, 7, 7, 7, 7, 7, 7,
+    8, 8, 8, 8, 8, 8, 8, 8, 8};
+
+const unsigned char CellCol[SUDOKU_CELLS] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8,
+    0, 1, 2, 3, 4, 5, 6, 7, 8,
+    0, 1, 2, 3, 4, 5, 6, 7, 8,
+    0, 1, 2, 3, 4, 5, 6, 7, 8,
+    0, 1, 2, 3, 4, 5, 6, 7, 8,
+    0, 1, 2, 3, 4, 5, 6, 7, 8,
+    0, 1, 2, 3, 4, 5, 6, 7, 8,
+    0, 1, 2, 3, 4, 5, 6, 7, 8,
+    0, 1, 2, 3, 4, 5, 6, 7, 8};
+
+const unsigned char CellBox[SUDOKU_CELLS] = {
+    0, 0, 0, 1, 1, 1, 2, 2, 2,
+    0, 0, 0, 1, 1, 1, 2, 2, 2,
+    0, 0, 0, 1, 1, 1, 2, 2, 2,
+    3, 3, 3, 4, 4, 4, 5, 5, 5,
+    3, 3, 3, 4, 4, 4, 5, 5, 5,
+    3, 3, 3, 4, 4, 4, 5, 5, 5,
+    6, 6, 6, 7, 7, 7, 8, 8, 8,
+    6, 6, 6, 7, 7, 7, 8, 8, 8,
+    6, 6, 6, 7, 7, 7, 8, 8, 8};
+#else
+SudokuIndex UnitCells[3 * SUDOKU_SIZE][SUDOKU_SIZE];
+unsigned char CellRow[SUDOKU_CELLS];
+unsigned char CellCol[SUDOKU_CELLS];
+unsigned char CellBox[SUDOKU_CELLS];
+
+/*
+ * Function: BuildTables
+ * --------------------
+ * Fill the unit and cell tables of the grid size of the build, run once before main
+*/
+__attribute__((constructor)) static void BuildTables(void)
+{
+    for (int index = 0; index < SUDOKU_CELLS; index++)
+    {
+        int row = index / SUDOKU_SIZE;
+        int col = index % SUDOKU_SIZE;
+        int box = row / SUDOKU_BOX * SUDOKU_BOX + col / SUDOKU_BOX;
+        CellRow[index] = row;
+        CellCol[index] = col;
+        CellBox[index] = box;
+        UnitCells[row][col] = index;
+        UnitCells[SUDOKU_SIZE + col][row] = index;
+        UnitCells[2 * SUDOKU_SIZE + box][row % SUDOKU_BOX * SUDOKU_BOX + col % SUDOKU_BOX] = index;
+    }
+}
+#endif
+
+/*
+ * Function: BoardInit
+ * --------------------
+ * Build the occupancy masks from the values already filled in the sudoku map
+ *
+ * board: occupancy masks to initialize
+ * map[]: sudoku map array, blank cells are 0
+ *
+ * returns: return 0 if a value is duplicated in a row, a column or a box, which means the sudoku is invalid. Otherwise, return 1.
+*/
+int BoardInit(struct Board *board, char map[])
+{
+    memset(board, 0, sizeof(*board));
+    for (int index = 0; index < SUDOKU_CELLS; index++)
+    {
+        int value = map[index];
+        if (value == 0)
+        {
+            continue;
+        }
+        // A value which is not a candidate any more is already used in the row, column or box of the cell
+        if (value < 0 || value > SUDOKU_SIZE || !(BoardCandidates(board, index) & (1u << (value - 1))))
+        {
+            return 0;
+        }
+        BoardSet(board, index, value, map);
+    }
+    return 1;
+}
+
+// One depth of the explicit stack of SolverCount. Backtracking pops the next candidate from remaining, and the cells filled
+// from blanks[mark] on are the undo log of the depth, so nothing is recomputed from the map.
+struct Frame
+{
+    SudokuMask remaining; // The candidates of the cell not tried yet, SolverDonate removes the donated ones
+    int mark;             // The position in blanks[] of the cell branched on, the cells after it up to nfill were forced by propagation
+};
+
+// The state of the SolverCount call running on this thread, read by SolverDonate from inside options->onPoll
+struct Search
+{
+    char *map;               // The sudoku map being searched
+    SudokuIndex *blanks;     // blanks[] of SolverCount
+    struct Frame *frames;    // frames[] of SolverCount
+    int depth;               // The current depth, its value is already filled in the map
+    int nfill;               // blanks[0..nfill-1] are filled
+    long long *count;        // The solutions found so far, read by SolverFrontier
+};
+
+static _Thread_local struct Search *activeSearch = NULL;
+
+// The number of SolverCountSymmetric calls running on this thread, whose searches must not give work away, see SolverDonate
+static _Thread_local int symmetryDepth = 0;
+
+// Set by SolverCancel, read by the searches of every thread at their poll points
+static atomic_int cancelled = 0;
+
+/*
+ * Function: SolverCancel
+ * --------------------
+ * Stop every search of the process: the running SolverCount and DlxCount calls return at their next poll point or
+ * solution with the solutions found so far, and the later calls return 0 at once. Safe to call from any thread and from
+ * inside options->onPoll.
+*/
+void SolverCancel(void)
+{
+    atomic_store_explicit(&cancelled, 1, memory_order_relaxed);
+}
+
+/*
+ * Function: SolverCancelled
+ * --------------------
+ * returns: 1 if SolverCancel has been called, otherwise, return 0
+*/
+int SolverCancelled(void)
+{
+    return atomic_load_explicit(&cancelled, memory_order_relaxed);
+}
+
+/*
+ * Function: SolverResume
+ * --------------------
+ * Clear SolverCancel, for a process which solves one puzzle after the other (--serve of the MPI program). No search
+ * may be running.
+*/
+void SolverResume(void)
+{
+    atomic_store_explicit(&cancelled, 0, memory_order_relaxed);
+}
+
+/*
+ * Function: SelectMRV
+ * --------------------
+ * Move the blank cell with the fewest candidates among blanks[pos..step-1] to blanks[pos]
+ *
+ * board: occupancy masks of the sudoku map
+ * blanks[]: index of the blank cells, blanks[pos..step-1] are the cells which are not filled yet
+ * pos, step: the current depth and the number of blank cells
+ * checks: increased by the number of cells looked at
+ *
+ * returns: the number of candidates of the selected cell, 0 means the current map can not be completed
+*/
+static int SelectMRV(const struct Board *board, SudokuIndex blanks[], int pos, int step, long long *checks)
+{
+    int best = pos;
+    int bestCount = SUDOKU_SIZE + 1;
+    int i;
+    for (i = pos; i < step; i++)
+    {
+        int n = __builtin_popcount(BoardCandidates(board, blanks[i]));
+        if (n < bestCount)
+        {
+            best = i;
+            bestCount = n;
+            // No cell can beat a cell with 0 or 1 candidates
+            if (n <= 1)
+            {
+                i++;
+                break;
+            }
+        }
+    }
+    *checks += i - pos;
+    SudokuIndex tmp = blanks[pos];
+    blanks[pos] = blanks[best];
+    blanks[best] = tmp;
+    return bestCount;
+}
+
+/*
+ * Function: FillForced
+ * --------------------
+ * Fill a value forced by constraint propagation and move the cell to the filled part blanks[0..nfill-1], keeping the
+ * row-major order of the cells which are still blank
+ *
+ * board: occupancy masks of the sudoku map
+ * map[]: sudoku map array
+ * blanks[]: index of the blank cells, blanks[0..nfill-1] are filled and blanks[nfill..step-1] are blank
+ * nfill: the number of filled cells in blanks[], increased by 1
+ * pos: position of the cell in blanks[], pos >= nfill
+ * value: the value filled in the cell
+*/
+static void FillForced(struct Board *board, char map[], SudokuIndex blanks[], int *nfill, int pos, int value)
+{
+    SudokuIndex index = blanks[pos];
+    memmove(&blanks[*nfill + 1], &blanks[*nfill], (pos - *nfill) * sizeof(SudokuIndex));
+    blanks[*nfill] = index;
+    (*nfill)++;
+    BoardSet(board, index, value, map);
+}
+
+/*
+ * Function: Propagate
+ * --------------------
+ * Fill every cell which has only one possible value, until nothing changes:
+ * naked single: a blank cell with exactly one candidate
+ * hidden single: a value which fits in exactly one blank cell of a row, a column or a box
+ *
+ * board: occupancy masks of the sudoku map
+ * map[]: sudoku map array
+ * blanks[]: index of the blank cells, blanks[0..nfill-1] are filled and blanks[nfill..step-1] are blank
+ * nfill: the number of filled cells in blanks[], increased by the number of forced cells
+ * step: the number of cells in blanks[]
+ * stats: stats->propagated is increased by the number of forced cells
+ *
+ * returns: return 0 if a blank cell has no candidate, or a value can not be placed anywhere in a unit, which means the
+ * current map has no solution. Otherwise, return 1.
+*/
+static int Propagate(struct Board *board, char map[], SudokuIndex blanks[], int *nfill, int step, struct SolverStats *stats)
+{
+    int changed = 1;
+    while (changed)
+    {
+        changed = 0;
+        // Naked singles
+        for (int i = *nfill; i < step; i++)
+        {
+            unsigned int candidates = BoardCandidates(board, blanks[i]);
+            if (candidates == 0)
+            {
+                return 0;
+            }
+            if ((candidates & (candidates - 1)) == 0)
+            {
+                FillForced(board, map, blanks, nfill, i, __builtin_ctz(candidates) + 1);
+                stats->propagated++;
+                changed = 1;
+            }
+        }
+        // Hidden singles, "once" collects the values which fit in at least one blank cell of the unit, "twice" in at least two
+        for (int unit = 0; unit < 3 * SUDOKU_SIZE; unit++)
+        {
+            unsigned int once = 0;
+            unsigned int twice = 0;
+            for (int k = 0; k < SUDOKU_SIZE; k++)
+            {
+                int index = UnitCells[unit][k];
+                if (map[index] == 0)
+                {
+                    unsigned int candidates = BoardCandidates(board, index);
+                    twice |= once & candidates;
+                    once |= candidates;
+                }
+            }
+            unsigned int used = unit < SUDOKU_SIZE ? board->row[unit] : unit < 2 * SUDOKU_SIZE ? board->col[unit - SUDOKU_SIZE] : board->box[unit - 2 * SUDOKU_SIZE];
+            if ((once | used) != SUDOKU_ALL_VALUES)
+            {
+                return 0;
+            }
+            unsigned int hidden = once & ~twice;
+            while (hidden)
+            {
+                int value = __builtin_ctz(hidden) + 1;
+                hidden &= hidden - 1;
+                // The only cell of the unit where the value fits, it is gone if another hidden single of the unit took it
+                int index = -1;
+                for (int k = 0; k < SUDOKU_SIZE; k++)
+                {
+                    int cell = UnitCells[unit][k];
+                    if (map[cell] == 0 && (BoardCandidates(board, cell) & (1u << (value - 1))))
+                    {
+                        index = cell;
+                        break;
+                    }
+                }
+                if (index < 0)
+                {
+                    return 0;
+                }
+                int pos = *nfill;
+                while (blanks[pos] != index)
+                {
+                    pos++;
+                }
+                FillForced(board, map, blanks, nfill, pos, value);
+                stats->propagated++;
+                changed = 1;
+            }
+        }
+    }
+    return 1;
+}
+
+/*
+ * Function: Binomial
+ * --------------------
+ * returns: the number of ways to choose k items out of n
+*/
+static long long Binomial(int n, int k)
+{
+    long long result = 1;
+    for (int i = 1; i <= k; i++)
+    {
+        result = result * (n - k + i) / i;
+    }
+    return result;
+}
+
+/*
+ * Function: SymmetryPlan
+ * --------------------
+ * Choose how SolverRepresentatives breaks the value symmetry of a puzzle: the values which no given uses, and the unit
+ * with the fewest blank cells, where every one of these values must appear. Only the smallest values are ordered when
+ * all of them would give more than SOLVER_SYMMETRY_TASKS subproblems, or a factor above SOLVER_SYMMETRY_VALUES!.
+ *
+ * map[]: sudoku map array
+ * unit: set to the unit, an index of UnitCells
+ * values: set to the values whose order is fixed, bit (value - 1) for each value
+ *
+ * returns: the number of values in values, 0 if there is no symmetry to use
+*/
+static int SymmetryPlan(const char map[], int *unit, SudokuMask *values)
+{
+    SudokuMask used = 0;
+    for (int i = 0; i < SUDOKU_CELLS; i++)
+    {
+        if (map[i] > 0 && map[i] <= SUDOKU_SIZE)
+        {
+            used |= 1u << (map[i] - 1);
+        }
+    }
+    SudokuMask free = ~used & SUDOKU_ALL_VALUES;
+    int blanks = SUDOKU_SIZE + 1;
+    for (int u = 0; u < 3 * SUDOKU_SIZE; u++)
+    {
+        int n = 0;
+        for (int j = 0; j < SUDOKU_SIZE; j++)
+        {
+            n += map[UnitCells[u][j]] == 0;
+        }
+        if (n < blanks)
+        {
+            blanks = n;
+            *unit = u;
+        }
+    }
+    // More free values than blank cells only happens in a puzzle without solution, any of them can be ordered
+    int k = __builtin_popcount(free);
+    k = k < SOLVER_SYMMETRY_VALUES ? k : SOLVER_SYMMETRY_VALUES;
+    k = k < blanks ? k : blanks;
+    while (k >= 2 && Binomial(blanks, k) > SOLVER_SYMMETRY_TASKS)
+    {
+        k--;
+    }
+    if (k < 2)
+    {
+        return 0;
+    }
+    // The k smallest free values
+    *values = 0;
+    for (int i = 0; i < k; i++)
+    {
+        *values |= free & -free;
+        free &= free - 1;
+    }
+    return k;
+}
+
+/*
+ * Function: SolverSymmetryFactor
+ * --------------------
+ * Get the number of solutions every solution of a task of SolverRepresentatives stands for
+ *
+ * map[]: sudoku map array
+ *
+ * returns: k! for the k values whose order SolverRepresentatives fixes, 1 if it fixes none
+*/
+long long SolverSymmetryFactor(const char map[])
+{
+    int unit;
+    SudokuMask values;
+    long long factor = 1;
+    for (int k = SymmetryPlan(map, &unit, &values); k > 1; k--)
+    {
+        factor *= k;
+    }
+    return factor;
+}
+
+/*
+ * Function: SolverRepresentatives
+ * --------------------
+ * Split a puzzle into one subproblem per class of its solutions under the relabeling of its free values. The values which
+ * no given uses can be exchanged with each other in any solution, which gives another solution, so the solutions come in
+ * classes of k! for k such values. Every one of them appears once in every unit, and a class has exactly one solution in
+ * which they appear in increasing order along the cells of a unit. The subproblems place them so in the unit with the
+ * fewest blank cells, one subproblem per choice of k of its blank cells; the solutions of the subproblems are exactly
+ * one solution of every class. The values and the unit are chosen by SymmetryPlan.
+ *
+ * map[]: sudoku map array
+ * taskNum: set to the number of subproblems
+ * factor: set to k!, the size of every class, 1 if the puzzle is its only subproblem
+ *
+ * returns: the subproblems, allocated with malloc and freed by the caller, NULL if the memory can not be allocated
+*/
+struct Task *SolverRepresentatives(const char map[], int *taskNum, long long *factor)
+{
+    int unit;
+    SudokuMask values;
+    int k = SymmetryPlan(map, &unit, &values);
+    int cells[SUDOKU_SIZE];
+    int blanks = 0;
+    for (int j = 0; k > 0 && j < SUDOKU_SIZE; j++)
+    {
+        if (map[UnitCells[unit][j]] == 0)
+        {
+            cells[blanks++] = UnitCells[unit][j];
+        }
+    }
+    int n = k > 0 ? (int)Binomial(blanks, k) : 1;
+    struct Task *tasks = malloc(n * sizeof(struct Task));
+    *taskNum = 0;
+    *factor = 1;
+    if (!tasks)
+    {
+        return NULL;
+    }
+    char node[SUDOKU_CELLS];
+    memcpy(node, map, SUDOKU_CELLS);
+    if (k == 0)
+    {
+        PackMap(node, tasks[0].grid);
+        *taskNum = 1;
+        return tasks;
+    }
+    // Every combination pick[0] < ... < pick[k - 1] of the blank cells of the unit, in lexicographic order
+    int pick[SUDOKU_SIZE];
+    for (int i = 0; i < k; i++)
+    {
+        pick[i] = i;
+    }
+    while (1)
+    {
+        SudokuMask left = values;
+        for (int i = 0; i < k; i++)
+        {
+            node[cells[pick[i]]] = __builtin_ctz(left) + 1;
+            left &= left - 1;
+        }
+        PackMap(node, tasks[(*taskNum)++].grid);
+        for (int i = 0; i < k; i++)
+        {
+            node[cells[pick[i]]] = 0;
+        }
+        int i = k - 1;
+        while (i >= 0 && pick[i] == blanks - k + i)
+        {
+            i--;
+        }
+        if (i < 0)
+        {
+            break;
+        }
+        pick[i]++;
+        for (int j = i + 1; j < k; j++)
+        {
+            pick[j] = pick[j - 1] + 1;
+        }
+    }
+    for (int i = 2; i <= k; i++)
+    {
+        *factor *= i;
+    }
+    return tasks;
+}
+
+/*
+ * Function: SolverCountSymmetric
+ * --------------------
+ * Count the solutions of the sudoku puzzle as SolverCount does, but only the ones of the subproblems of
+ * SolverRepresentatives, one per class of solutions, and multiply by the size of the classes. The representatives are
+ * counted with options->limit divided by the size of the classes, and the count is at most options->limit.
+ *
+ * map[]: sudoku map array
+ * options: the options of SolverCount, options->onSolution must be NULL since only the representatives are visited
+ * stats: the counters of the search are added to it, may be NULL
+ *
+ * returns: the number of solutions to the sudoku puzzle, 0 if the input is invalid
+*/
+static long long SolverCountSymmetric(char map[], const struct SolverOptions *options, struct SolverStats *stats)
+{
+    struct SolverOptions local = *options;
+    int n;
+    long long factor;
+    local.symmetry = 0;
+    struct Task *tasks = SolverRepresentatives(map, &n, &factor);
+    if (!tasks || factor == 1)
+    {
+        free(tasks);
+        return SolverCount(map, &local, stats);
+    }
+    long long limit = options->limit > 0 ? (options->limit + factor - 1) / factor : 0;
+    long long count = 0;
+    char node[SUDOKU_CELLS];
+    symmetryDepth++;
+    for (int i = 0; i < n && (limit == 0 || count < limit) && !SolverCancelled(); i++)
+    {
+        UnpackMap(tasks[i].grid, node);
+        local.limit = limit > 0 ? limit - count : 0;
+        count += SolverCount(node, &local, stats);
+    }
+    symmetryDepth--;
+    free(tasks);
+    count *= factor;
+    return options->limit > 0 && count > options->limit ? options->limit : count;
+}
+
+/*
+ * Function: SolverCount
+ * --------------------
+ * Count the solutions of the sudoku puzzle by backtracking over the blank cells, with an explicit stack of struct Frame.
+ * The candidates of a cell are computed once when the search reaches its depth, and every value tried pops the lowest one
+ * left with a ctz; coming back to the depth undoes the cells filled since its mark, so nothing is read back from the map.
+ * With options->symmetry and no options->onSolution the puzzle is counted by SolverCountSymmetric instead.
+ * With SOLVER_ORDER_STATIC the blank cells are filled in row-major order, which visits the same tree as the original
+ * IsValid based loop in SudokuSolution. With SOLVER_ORDER_MRV the cell filled at each depth is the one with the fewest
+ * candidates, and a cell without any candidate makes the search backtrack at once. Both orders count every solution.
+ * With options->propagate the forced cells are filled by Propagate before the search and after every value tried, so
+ * only the cells with a real choice are branched on.
+ * With SOLVER_BACKEND_DLX the count is done by DlxCount in sudoku_dlx.c instead, order and propagate are ignored.
+ * While options->onPoll runs, SolverDonate can hand the untried values of the shallowest depths over to another process.
+ * The search stops early once options->limit solutions are found, or when SolverCancel is called.
+ *
+ * map[]: sudoku map array, restored to the input puzzle when the function returns
+ * options: order of the blank cells, constraint propagation, the callback for every solution found and the polling callback
+ * stats: the counters of the search are added to it, may be NULL
+ *
+ * returns: the number of solutions to the sudoku puzzle, 0 if the input is invalid
+*/
+long long SolverCount(char map[], const struct SolverOptions *options, struct SolverStats *stats)
+{
+    if (SolverCancelled())
+    {
+        return 0;
+    }
+    if (options->symmetry && !options->onSolution)
+    {
+        return SolverCountSymmetric(map, options, stats);
+    }
+    if (options->backend == SOLVER_BACKEND_DLX)
+    {
+        return DlxCount(map, options, stats);
+    }
+    struct Board board;
+    struct SolverStats local = {0, 0, 0, 0};
+    long long count = 0;
+    if (!BoardInit(&board, map))
+    {
+        return count;
+    }
+    // Keep the options in locals, writes through map[] could alias *options and force a reload on every step
+    const int order = options->order;
+    const int propagate = options->propagate;
+    const long long limit = options->limit;
+    void (*const onPoll)(void) = options->onPoll;
+
+    // Record the index of the blank cells, "step" is the number of cells which need to be filled in
+    // blanks[0..nfill-1] are the cells filled so far, in the order they were filled, blanks[nfill..step-1] are still blank
+    SudokuIndex blanks[SUDOKU_CELLS];
+    int step = 0;
+    int nfill = 0;
+    for (int index = 0; index < SUDOKU_CELLS; index++)
+    {
+        if (map[index] == 0)
+        {
+            blanks[step++] = index;
+        }
+    }
+
+    // frames[depth] holds the candidates left at each depth and the start of its undo log in blanks[], on cache line boundaries
+    _Alignas(64) struct Frame frames[SUDOKU_CELLS];
+    struct Frame *frame = frames;
+    int depth = 0;
+    struct Search search = {map, blanks, frames, 0, 0, &count};
+    struct Search *outer = activeSearch;
+    activeSearch = &search;
+    // 1: the search moved forward to a new depth, 0: it came back to depth from a deeper one
+    int advance = 1;
+    // 1: SolverCancel was called, the cells filled so far are cleared and the search ends
+    int stopped = 0;
+    long long nodes = 0;
+    long long backtracks = 0;
+    long long checks = 0;
+    if (propagate && !Propagate(&board, map, blanks, &nfill, step, &local))
+    {
+        depth = -1;
+    }
+    while (depth >= 0)
+    {
+        if (advance)
+        {
+            // When all the blank cells are filled, a valid solution for the sudoku puzzle is found successfully
+            if (nfill == step)
+            {
+                count++;
+                if (options->onSolution)
+                {
+                    options->onSolution(map);
+                }
+                // Every cell is filled, so the clean-up below restores the map
+                if ((limit > 0 && count >= limit) || SolverCancelled())
+                {
+                    break;
+                }
+                depth--;
+                advance = 0;
+                continue;
+            }
+            // Pick the cell of this depth, a cell without any candidate means the value in the last cell was wrong
+            if (order == SOLVER_ORDER_MRV && SelectMRV(&board, blanks, nfill, step, &checks) == 0)
+            {
+                backtracks++;
+                depth--;
+                advance = 0;
+                continue;
+            }
+            // The candidates of the cell do not change until the search comes back above this depth, they are computed once
+            frame = &frames[depth];
+            frame->mark = nfill;
+            frame->remaining = BoardCandidates(&board, blanks[nfill]);
+            checks++;
+        }
+        else
+        {
+            // Pop: undo the cells forced after the value of this depth, then the value itself
+            frame = &frames[depth];
+            for (int i = frame->mark + 1; i < nfill; i++)
+            {
+                BoardUnset(&board, blanks[i], map);
+            }
+            BoardUnset(&board, blanks[frame->mark], map);
+        }
+        int index = blanks[frame->mark];
+        // Take the first candidate left which propagation does not refute
+        unsigned int candidates = frame->remaining;
+        advance = 0;
+        while (candidates)
+        {
+            BoardSet(&board, index, __builtin_ctz(candidates) + 1, map);
+            candidates &= candidates - 1;
+            frame->remaining = candidates;
+            nodes++;
+            nfill = frame->mark + 1;
+            if ((nodes & (SOLVER_POLL_INTERVAL - 1)) == 0)
+            {
+                if (onPoll)
+                {
+                    search.depth = depth;
+                    search.nfill = nfill;
+                    onPoll();
+                }
+                if (SolverCancelled())
+                {
+                    stopped = 1;
+                    break;
+                }
+            }
+            if (!propagate || Propagate(&board, map, blanks, &nfill, step, &local))
+            {
+                advance = 1;
+                break;
+            }
+            for (int i = frame->mark + 1; i < nfill; i++)
+            {
+                BoardUnset(&board, blanks[i], map);
+            }
+            BoardUnset(&board, index, map);
+        }
+        if (stopped)
+        {
+            break;
+        }
+        if (advance)
+        {
+            depth++;
+        }
+        // No candidate left, the cell is blank again and the value in the last cell was wrong
+        else
+        {
+            nfill = frame->mark;
+            backtracks++;
+            depth--;
+        }
+    }
+
+    // Clear the cells filled by the propagation before the search
+    for (int i = 0; i < nfill; i++)
+    {
+        BoardUnset(&board, blanks[i], map);
+    }
+    activeSearch = outer;
+    if (stats)
+    {
+        stats->nodes += nodes;
+        stats->propagated += local.propagated;
+        stats->backtracks += backtracks;
+        stats->checks += checks;
+    }
+    return count;
+}
+
+// The target of SolverCountFirst in the calling thread, see RecordFirst
+static _Thread_local struct Task *firstSolution;
+static _Thread_local int firstFound;
+static _Thread_local void (*firstNext)(char map[]);
+
+/*
+ * Function: RecordFirst
+ * --------------------
+ * The onSolution hook of SolverCountFirst: pack the first solution, then call the hook of the caller
+ *
+ * map[]: the solution
+*/
+static void RecordFirst(char map[])
+{
+    if (!firstFound)
+    {
+        PackMap(map, firstSolution->grid);
+        firstFound = 1;
+    }
+    if (firstNext)
+    {
+        firstNext(map);
+    }
+}
+
+/*
+ * Function: SolverCountFirst
+ * --------------------
+ * Count the solutions like SolverCount, and keep the first one found, for the result cache (sudoku_cache.h)
+ *
+ * map[]: sudoku map array, restored to the input puzzle when the function returns
+ * options: the options of SolverCount, options->onSolution is still called for every solution
+ * stats: the counters of the search are added to it, may be NULL
+ * first: filled with the first solution, packed by PackMap, when there is one
+ *
+ * returns: the number of solutions to the sudoku puzzle
+*/
+long long SolverCountFirst(char map[], const struct SolverOptions *options, struct SolverStats *stats, struct Task *first)
+{
+    struct SolverOptions local = *options;
+    struct Task *outerSolution = firstSolution;
+    int outerFound = firstFound;
+    void (*outerNext)(char map[]) = firstNext;
+    local.onSolution = RecordFirst;
+    firstSolution = first;
+    firstFound = 0;
+    firstNext = options->onSolution;
+    long long count = SolverCount(map, &local, stats);
+    firstSolution = outerSolution;
+    firstFound = outerFound;
+    firstNext = outerNext;
+    return count;
+}
+
+/*
+ * Function: SolverDonate
+ * --------------------
+ * Give away the untried values of the shallowest depth of the running search, namely the siblings closest to the top of the
+ * stack, which are the largest subtrees left. Every untried value which is legal at that depth becomes a task, and the search
+ * will not try it any more, so the solutions are still counted exactly once. Only valid inside options->onPoll of a
+ * SolverCount call with the backtracking backend, otherwise nothing is donated.
+ *
+ * tasks[]: filled with the donated tasks
+ * max: the maximum number of tasks, the lowest values are kept when there are more
+ *
+ * returns: the number of donated tasks, 0 if the search has nothing left to give away
+*/
+int SolverDonate(struct Task tasks[], int max)
+{
+    struct Search *search = activeSearch;
+    // A subtree of a representative stands for several solutions, the process which would get it counts it only once
+    if (!search || max <= 0 || symmetryDepth > 0)
+    {
+        return 0;
+    }
+    for (int d = 0; d < search->depth; d++)
+    {
+        struct Frame *frame = &search->frames[d];
+        int index = search->blanks[frame->mark];
+        unsigned int legal = frame->remaining;
+        if (!legal)
+        {
+            continue;
+        }
+        // The map as it was at depth d, before its cell and the cells after it were filled
+        char grid[SUDOKU_CELLS];
+        memcpy(grid, search->map, SUDOKU_CELLS);
+        for (int i = frame->mark; i < search->nfill; i++)
+        {
+            grid[search->blanks[i]] = 0;
+        }
+        int n = 0;
+        while (legal && n < max)
+        {
+            int bit = 31 - __builtin_clz(legal);
+            legal &= ~(1u << bit);
+            frame->remaining &= ~(1u << bit);
+            grid[index] = bit + 1;
+            PackMap(grid, tasks[n++].grid);
+        }
+        if (n > 0)
+        {
+            return n;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Function: SolverFrontier
+ * --------------------
+ * Describe the work left to the running search as tasks, without changing it: the node being searched, whose subtree is
+ * not started yet at a poll point, and the untried legal values of every depth above it, like SolverDonate. Counting the
+ * solutions of the tasks and adding the solutions found so far gives the count of the whole search. Only valid inside
+ * options->onPoll of a SolverCount call with the backtracking backend.
+ *
+ * tasks[]: filled with the tasks, room for SOLVER_FRONTIER_MAX of them
+ * count: set to the number of solutions the search has found so far
+ *
+ * returns: the number of tasks, -1 if no search can be described: none is running on this thread, or it is one
+ *          representative of SolverCountSymmetric, whose solutions stand for several
+*/
+int SolverFrontier(struct Task tasks[], long long *count)
+{
+    struct Search *search = activeSearch;
+    if (!search || symmetryDepth > 0)
+    {
+        return -1;
+    }
+    int n = 0;
+    char grid[SUDOKU_CELLS];
+    PackMap(search->map, tasks[n++].grid);
+    for (int d = 0; d <= search->depth; d++)
+    {
+        const struct Frame *frame = &search->frames[d];
+        int index = search->blanks[frame->mark];
+        unsigned int legal = frame->remaining;
+        if (!legal)
+        {
+            continue;
+        }
+        // The map as it was at depth d, before its cell and the cells after it were filled
+        memcpy(grid, search->map, SUDOKU_CELLS);
+        for (int i = frame->mark; i < search->nfill; i++)
+        {
+            grid[search->blanks[i]] = 0;
+        }
+        while (legal)
+        {
+            grid[index] = __builtin_ctz(legal) + 1;
+            legal &= legal - 1;
+            PackMap(grid, tasks[n++].grid);
+        }
+    }
+    *count = *search->count;
+    return n;
+}
+
+/*
+ * Function: SolverPropagate
+ * --------------------
+ * Fill the naked and hidden singles of the sudoku map in place, without any branching
+ *
+ * map[]: sudoku map array
+ * stats: stats->propagated is increased by the number of forced cells, may be NULL
+ *
+ * returns: return 0 if the sudoku is invalid or the propagation proves it has no solution. Otherwise, return 1.
+*/
+int SolverPropagate(char map[], struct SolverStats *stats)
+{
+    struct Board board;
+    struct SolverStats local = {0, 0, 0, 0};
+    if (!BoardInit(&board, map))
+    {
+        return 0;
+    }
+    SudokuIndex blanks[SUDOKU_CELLS];
+    int step = 0;
+    int nfill = 0;
+    for (int index = 0; index < SUDOKU_CELLS; index++)
+    {
+        if (map[index] == 0)
+        {
+            blanks[step++] = index;
+        }
+    }
+    int ret = Propagate(&board, map, blanks, &nfill, step, &local);
+    if (stats)
+    {
+        stats->propagated += local.propagated;
+    }
+    return ret;
+}
+
+/*
+ * Function: PackMap
+ * --------------------
+ * Pack the sudoku map into 4 bits per cell, cell 2 * i in the low half and cell 2 * i + 1 in the high half of packed[i].
+ * The values of the 16x16 and 25x25 grids do not fit in 4 bits, their maps are copied with 1 byte per cell.
+ *
+ * map[]: sudoku map array
+ * packed[]: SUDOKU_PACKED_SIZE bytes
+*/
+void PackMap(const char map[], unsigned char packed[])
+{
+#if SUDOKU_PACKED_BITS == 8
+    memcpy(packed, map, SUDOKU_CELLS);
+#else
+    for (int i = 0; i < SUDOKU_PACKED_SIZE; i++)
+    {
+        int high = 2 * i + 1 < SUDOKU_CELLS ? map[2 * i + 1] : 0;
+        packed[i] = map[2 * i] | high << 4;
+    }
+#endif
+}
+
+/*
+ * Function: UnpackMap
+ * --------------------
+ * Unpack a map packed by PackMap
+ *
+ * packed[]: SUDOKU_PACKED_SIZE bytes
+ * map[]: sudoku map array
+*/
+void UnpackMap(const unsigned char packed[], char map[])
+{
+#if SUDOKU_PACKED_BITS == 8
+    memcpy(map, packed, SUDOKU_CELLS);
+#else
+    for (int index = 0; index < SUDOKU_CELLS; index++)
+    {
+        map[index] = packed[index / 2] >> (index % 2 * 4) & 0xF;
+    }
+#endif
+}
+
+/*
+ * Function: SolverSplit
+ * --------------------
+ * Split the sudoku puzzle into independent subproblems by expanding the search tree breadth-first. A subproblem is expanded on
+ * the blank cell with the fewest candidates, into one child per candidate, so only legal assignments become tasks. With
+ * options->propagate the children are propagated as well, and the children which propagation refutes are dropped. The
+ * expansion stops when there are at least target subproblems, or when no subproblem has a blank cell left. The solutions
+ * of the puzzle are exactly the solutions of the tasks, each of them found by one task only. With options->symmetry and no
+ * options->onSolution the expansion starts from the subproblems of SolverRepresentatives instead of the puzzle, and every
+ * solution of the tasks stands for SolverSymmetryFactor(map) solutions of the puzzle.
+ *
+ * map[]: sudoku map array
+ * options: options->propagate, options->symmetry and options->onSolution are used
+ * target: the number of tasks wanted
+ * taskNum: the number of tasks returned
+ *
+ * returns: the tasks, allocated with malloc and freed by the caller. NULL if there is no task, because the puzzle is invalid
+ * or has no solution, or if the memory can not be allocated.
+*/
+struct Task *SolverSplit(char map[], const struct SolverOptions *options, int target, int *taskNum)
+{
+    struct Board board;
+    char node[SUDOKU_CELLS];
+    *taskNum = 0;
+    if (target < 1)
+    {
+        target = 1;
+    }
+    memcpy(node, map, SUDOKU_CELLS);
+    if (!BoardInit(&board, node))
+    {
+        return NULL;
+    }
+    int starts = 1;
+    long long factor;
+    struct Task *start = options->symmetry && !options->onSolution ? SolverRepresentatives(node, &starts, &factor) : NULL;
+    if (options->symmetry && !options->onSolution && !start)
+    {
+        return NULL;
+    }
+
+    // The subproblems are kept in a circular queue, expanding one of them adds at most SUDOKU_SIZE - 1
+    int capacity = (target > starts ? target : starts) + SUDOKU_SIZE;
+    struct Task *queue = malloc(capacity * sizeof(struct Task));
+    if (!queue)
+    {
+        free(start);
+        return NULL;
+    }
+    int head = 0;
+    int size = 0;
+    for (int i = 0; i < starts; i++)
+    {
+        if (start)
+        {
+            UnpackMap(start[i].grid, node);
+        }
+        if (!options->propagate || SolverPropagate(node, NULL))
+        {
+            PackMap(node, queue[size++].grid);
+        }
+    }
+    free(start);
+    // The number of subproblems popped in a row without a blank cell, when it reaches size nothing can be expanded any more
+    int full = 0;
+    while (size < target && full < size)
+    {
+        struct Task task = queue[head];
+        head = (head + 1) % capacity;
+        size--;
+        UnpackMap(task.grid, node);
+        BoardInit(&board, node);
+
+        // Pick the blank cell with the fewest candidates
+        int best = -1;
+        int bestCount = SUDOKU_SIZE + 1;
+        for (int index = 0; index < SUDOKU_CELLS; index++)
+        {
+            if (node[index] == 0)
+            {
+                int n = __builtin_popcount(BoardCandidates(&board, index));
+                if (n < bestCount)
+                {
+                    best = index;
+                    bestCount = n;
+                }
+            }
+        }
+        if (best < 0)
+        {
+            queue[(head + size) % capacity] = task;
+            size++;
+            full++;
+            continue;
+        }
+        full = 0;
+
+        // Add one child per candidate, a cell without candidate simply adds no child
+        unsigned int candidates = BoardCandidates(&board, best);
+        while (candidates)
+        {
+            char child[SUDOKU_CELLS];
+            memcpy(child, node, SUDOKU_CELLS);
+            child[best] = __builtin_ctz(candidates) + 1;
+            candidates &= candidates - 1;
+            if (options->propagate && !SolverPropagate(child, NULL))
+            {
+                continue;
+            }
+            PackMap(child, queue[(head + size) % capacity].grid);
+            size++;
+        }
+    }
+
+    // Move the tasks to the front of the array, in the order of the queue
+    struct Task *tasks = malloc((size > 0 ? size : 1) * sizeof(struct Task));
+    if (tasks)
+    {
+        for (int i = 0; i < size; i++)
+        {
+            tasks[i] = queue[(head + i) % capacity];
+        }
+        *taskNum = size;
+    }
+    free(queue);
+    if (tasks && size == 0)
+    {
+        free(tasks);
+        tasks = NULL;
+    }
+    return tasks;
+}
+
+/*
+ * Function: ParseSolverOption
+ * --------------------
+ * Read one solver option
+ * --solver=backtrack: count with the bitmask backtracking of SolverCount (default)
+ * --solver=dlx: count with the Dancing Links exact cover search of DlxCount
+ * --order=static: fill the blank cells in row-major order (default)
+ * --order=mrv: fill the blank cell with the fewest candidates first
+ * --propagate: fill the naked and hidden singles before the search and after every value tried
+ * --symmetry: count one solution per relabeling of the values which no given uses, when the solutions are not visited
+ * --find=all: count every solution (default)
+ * --find=first: stop at the first solution
+ * --find=unique: stop at the second solution, enough to tell whether the solution is unique
+ * --find=N: stop after N solutions
+ *
+ * arg: the option
+ * options: the options to fill in
+ *
+ * returns: return 1 if arg is a solver option, otherwise, return 0
+*/
+int ParseSolverOption(const char *arg, struct SolverOptions *options)
+{
+    if (strcmp(arg, "--solver=backtrack") == 0)
+    {
+        options->backend = SOLVER_BACKEND_BACKTRACK;
+    }
+    else if (strcmp(arg, "--solver=dlx") == 0)
+    {
+        options->backend = SOLVER_BACKEND_DLX;
+    }
+    else if (strcmp(arg, "--order=static") == 0)
+    {
+        options->order = SOLVER_ORDER_STATIC;
+    }
+    else if (strcmp(arg, "--order=mrv") == 0)
+    {
+        options->order = SOLVER_ORDER_MRV;
+    }
+    else if (strcmp(arg, "--propagate") == 0)
+    {
+        options->propagate = 1;
+    }
+    else if (strcmp(arg, "--symmetry") == 0)
+    {
+        options->symmetry = 1;
+    }
+    else if (strncmp(arg, "--find=", 7) == 0)
+    {
+        const char *mode = arg + 7;
+        char *end;
+        if (strcmp(mode, "all") == 0)
+        {
+            options->limit = 0;
+        }
+        else if (strcmp(mode, "first") == 0)
+        {
+            options->limit = 1;
+        }
+        else if (strcmp(mode, "unique") == 0)
+        {
+            options->limit = 2;
+        }
+        else if ((options->limit = strtoll(mode, &end, 10)) <= 0 || *end != '\0')
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Function: ParseSolverOptions
+ * --------------------
+ * Read the options given before the coordinates and values of the sudoku puzzle, for example:
+ * ./sudoku_serial --order=mrv 1 1 2 1 4 6
+ * The solver options are listed in ParseSolverOption, the options of the program itself are handed to parseOption.
+ *
+ * argc: the number of the parameters when the user executes the program
+ * argv: the parameters when the user executes the program
+ * options: the options to fill in
+ * parseOption: reads an option of the program and returns 1 if arg is one of them, may be NULL
+ *
+ * returns: the number of parameters consumed as options, -1 if an option is not valid. The caller skips them with
+ * argc -= n; argv += n; so that argv[1] is the first coordinate again for ParseArgv.
+*/
+int ParseSolverOptions(int argc, char **argv, struct SolverOptions *options, int (*parseOption)(const char *arg))
+{
+    int n = 0;
+    while (n + 1 < argc && strncmp(argv[n + 1], "--", 2) == 0)
+    {
+        const char *arg = argv[n + 1];
+        if (!ParseSolverOption(arg, options) && !(parseOption && parseOption(arg)))
+        {
+            printf("Unknown option %s!\n", arg);
+            return -1;
+        }
+        n++;
+    }
+    return n;
+}
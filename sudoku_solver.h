@@ -0,0 +1,224 @@
+#ifndef SUDOKU_SOLVER_H
+#define SUDOKU_SOLVER_H
+
+/*
+ * Bitmask solver core shared by sudoku_serial and the MPI slave processes.
+ *
+ * Instead of rescanning the row, the column and the box of a cell through GetCellValue for every trial value (IsValid),
+ * the solver keeps one SUDOKU_SIZE-bit occupancy mask per row, per column and per box. Bit (value - 1) is set when value is already
+ * used in that unit, so the candidates of a blank cell are ~(row | column | box) and the next candidate is a ctz away.
+ * The masks are updated incrementally whenever a cell is set or cleared.
+ *
+ * Cells are addressed by index = (x - 1) * SUDOKU_SIZE + y - 1, the same layout as map[SUDOKU_CELLS].
+ *
+ * The size of the grid is fixed at compile time by SUDOKU_BOX, the side of a box: 3 for the usual 9x9 grid (default),
+ * -DSUDOKU_BOX=4 for 16x16 and -DSUDOKU_BOX=5 for 25x25. Every size is a separate build of the same sources, so the
+ * loop bounds, the mask types and the tables are constants and the 9x9 build is the same code as before.
+*/
+
+#ifndef SUDOKU_BOX
+#define SUDOKU_BOX 3
+#endif
+#if SUDOKU_BOX < 2 || SUDOKU_BOX > 5
+#error "SUDOKU_BOX must be between 2 and 5, the masks of a 36x36 grid do not fit in 32 bits"
+#endif
+
+#define SUDOKU_SIZE (SUDOKU_BOX * SUDOKU_BOX)
+#define SUDOKU_CELLS (SUDOKU_SIZE * SUDOKU_SIZE)
+#define SUDOKU_ALL_VALUES ((1u << SUDOKU_SIZE) - 1)
+
+// A set of values, bit (value - 1) for each value
+#if SUDOKU_SIZE <= 16
+typedef unsigned short SudokuMask;
+#else
+typedef unsigned int SudokuMask;
+#endif
+
+// The index of a cell in the map
+#if SUDOKU_CELLS <= 256
+typedef unsigned char SudokuIndex;
+#else
+typedef unsigned short SudokuIndex;
+#endif
+
+// Bytes of a map packed by PackMap, 4 bits per cell while the values fit, otherwise 1 byte per cell
+#if SUDOKU_SIZE < 16
+#define SUDOKU_PACKED_BITS 4
+#define SUDOKU_PACKED_SIZE ((SUDOKU_CELLS + 1) / 2)
+#else
+#define SUDOKU_PACKED_BITS 8
+#define SUDOKU_PACKED_SIZE SUDOKU_CELLS
+#endif
+
+// Order in which SolverCount picks the next blank cell to fill
+#define SOLVER_ORDER_STATIC 0 // Row-major order of the blank cells, as in the original SudokuSolution
+#define SOLVER_ORDER_MRV 1    // At each depth the blank cell with the fewest candidates (minimum remaining values)
+
+// Algorithm used by SolverCount
+#define SOLVER_BACKEND_BACKTRACK 0 // Bitmask backtracking over the blank cells
+#define SOLVER_BACKEND_DLX 1       // Dancing Links (Algorithm X) over the exact cover matrix, see sudoku_dlx.c
+
+// Options of the solver, selected on the command line through ParseSolverOptions
+struct SolverOptions
+{
+    int backend;                       // SOLVER_BACKEND_BACKTRACK or SOLVER_BACKEND_DLX
+    int order;                         // SOLVER_ORDER_STATIC or SOLVER_ORDER_MRV
+    int propagate;                     // 1: fill naked and hidden singles before the search and after every assignment
+    void (*onSolution)(char map[]);    // Called with the filled map for every solution found, may be NULL
+    void (*onPoll)(void);              // Called every SOLVER_POLL_INTERVAL search nodes, may be NULL
+    long long limit;                   // Stop after this many solutions, 0 counts them all (--find)
+    int symmetry;                      // 1: count one solution per relabeling of the values no given uses, see SolverCountSymmetric
+};
+
+// SolverRepresentatives makes at most SOLVER_SYMMETRY_TASKS subproblems, and fixes the order of at most SOLVER_SYMMETRY_VALUES
+// values, whose factorial still fits in a long long
+#define SOLVER_SYMMETRY_TASKS 4096
+#define SOLVER_SYMMETRY_VALUES 20
+
+// The most tasks SolverFrontier can describe a search with: the node being searched and the untried values of every depth
+#define SOLVER_FRONTIER_MAX (SUDOKU_CELLS * (SUDOKU_SIZE - 1) + 1)
+
+// Number of search nodes between two calls of SolverOptions.onPoll, a power of 2
+#define SOLVER_POLL_INTERVAL (1 << 14)
+
+// Counters of the solver, SolverCount and SolverPropagate add to them
+struct SolverStats
+{
+    long long nodes;      // Values tried in a blank cell by branching
+    long long propagated; // Cells filled by constraint propagation without branching
+    long long backtracks; // Cells (DLX: columns) left with no value to try, the search goes back up
+    long long checks;     // Candidate sets computed to pick and branch on a cell (DLX: columns compared to pick one)
+};
+
+// Options used by SudokuSolution, filled by ParseSolverOptions
+extern struct SolverOptions SolverConfig;
+
+// Counters of all the SudokuSolution calls of the process
+extern struct SolverStats SolverTotals;
+
+// A subproblem of the search produced by SolverSplit, the sudoku map with its first cells filled, packed by PackMap
+struct Task
+{
+    unsigned char grid[SUDOKU_PACKED_SIZE];
+};
+
+// Puzzles advanced in lockstep by SolverCountTasks, 16 masks of 16 bits fill an AVX2 register
+#define SOLVER_LANES 16
+
+// Occupancy masks of the rows, columns and boxes of a sudoku map
+struct Board
+{
+    SudokuMask row[SUDOKU_SIZE];
+    SudokuMask col[SUDOKU_SIZE];
+    SudokuMask box[SUDOKU_SIZE];
+};
+
+// The tables of the 9x9 grid are written out in sudoku_solver.c, the ones of the larger grids are built at startup
+#if SUDOKU_BOX == 3
+#define SUDOKU_TABLE const
+#else
+#define SUDOKU_TABLE
+#endif
+
+// Index of the SUDOKU_SIZE cells of each unit: the rows first, then the columns, then the boxes
+extern SUDOKU_TABLE SudokuIndex UnitCells[3 * SUDOKU_SIZE][SUDOKU_SIZE];
+
+// Row, column and box (0 to SUDOKU_SIZE - 1) of each cell index, filled in sudoku_solver.c
+extern SUDOKU_TABLE unsigned char CellRow[SUDOKU_CELLS];
+extern SUDOKU_TABLE unsigned char CellCol[SUDOKU_CELLS];
+extern SUDOKU_TABLE unsigned char CellBox[SUDOKU_CELLS];
+
+/*
+ * Function: BoardCandidates
+ * --------------------
+ * Get the values which could still be filled in the cell without duplicating its row, column or box
+ *
+ * board: occupancy masks of the sudoku map
+ * index: index of the cell in map[SUDOKU_CELLS]
+ *
+ * returns: a mask in which bit (value - 1) is set for every possible value
+*/
+static inline unsigned int BoardCandidates(const struct Board *board, int index)
+{
+    return ~(board->row[CellRow[index]] | board->col[CellCol[index]] | board->box[CellBox[index]]) & SUDOKU_ALL_VALUES;
+}
+
+/*
+ * Function: BoardSet
+ * --------------------
+ * Fill value in the cell and mark it as used in the row, column and box of the cell
+ *
+ * board: occupancy masks of the sudoku map
+ * index: index of the cell in map[SUDOKU_CELLS], the cell must be blank
+ * value: the value (1 to SUDOKU_SIZE) filled in the cell
+ * map[]: sudoku map array
+*/
+static inline void BoardSet(struct Board *board, int index, int value, char map[])
+{
+    SudokuMask bit = 1u << (value - 1);
+    board->row[CellRow[index]] |= bit;
+    board->col[CellCol[index]] |= bit;
+    board->box[CellBox[index]] |= bit;
+    map[index] = value;
+}
+
+/*
+ * Function: BoardUnset
+ * --------------------
+ * Clear the cell back to 0 and release its value in the row, column and box of the cell
+ *
+ * board: occupancy masks of the sudoku map
+ * index: index of the cell in map[SUDOKU_CELLS], the cell must not be blank
+ * map[]: sudoku map array
+*/
+static inline void BoardUnset(struct Board *board, int index, char map[])
+{
+    SudokuMask bit = ~(1u << (map[index] - 1));
+    board->row[CellRow[index]] &= bit;
+    board->col[CellCol[index]] &= bit;
+    board->box[CellBox[index]] &= bit;
+    map[index] = 0;
+}
+
+int BoardInit(struct Board *board, char map[]);
+
+long long SolverCount(char map[], const struct SolverOptions *options, struct SolverStats *stats);
+
+long long SolverSymmetryFactor(const char map[]);
+
+struct Task *SolverRepresentatives(const char map[], int *taskNum, long long *factor);
+
+long long SolverCountFirst(char map[], const struct SolverOptions *options, struct SolverStats *stats, struct Task *first);
+
+int SolverPropagate(char map[], struct SolverStats *stats);
+
+int SolverDonate(struct Task tasks[], int max);
+
+int SolverFrontier(struct Task tasks[], long long *count);
+
+void SolverCancel(void);
+
+int SolverCancelled(void);
+
+void SolverResume(void);
+
+int SolverCheck(const char map[]);
+
+int SolverCheckTasks(const struct Task tasks[], int n, unsigned char valid[]);
+
+long long SolverCountTasks(const struct Task tasks[], int n, const struct SolverOptions *options, struct SolverStats *stats,
+                           long long counts[], double seconds[], struct Task firsts[]);
+
+long long DlxCount(char map[], const struct SolverOptions *options, struct SolverStats *stats);
+
+void PackMap(const char map[], unsigned char packed[]);
+
+void UnpackMap(const unsigned char packed[], char map[]);
+
+struct Task *SolverSplit(char map[], const struct SolverOptions *options, int target, int *taskNum);
+
+int ParseSolverOption(const char *arg, struct SolverOptions *options);
+
+int ParseSolverOptions(int argc, char **argv, struct SolverOptions *options, int (*parseOption)(const char *arg));
+
+#endif